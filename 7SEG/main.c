@@ -13,6 +13,8 @@ Main file of the microcontroller responsible for operation of
 
 #include "../lib/comm.h" /* Serial communication control */
 
+#include "../lib/timing.h" /* Reload values of the timers */
+
 static volatile bit timer; /* Stores whether the mixer runs with timer or without */
 
 /*------------------------------------------------
@@ -23,8 +25,8 @@ On interrupt change state of blinking segment.
 void t0_int(void) interrupt TF0_VECTOR {
 	TR0 = 0; /* Stop timer 0 */
 	TF0 = 0; /* Reset overflow flag */
-	TH0 = 0x00; /* Reset value for 8 higher bits */
-	TL0 = 0x00; /* Reset value for 8 lower bits */
+	TH0 = BLINK_RELOAD >> 8; /* Reset value for 8 higher bits */
+	TL0 = BLINK_RELOAD & 0xFF; /* Reset value for 8 lower bits */
 	
 	seg_display_blink(); /* Blink the display */
 	
@@ -49,27 +51,11 @@ void t1_int(void) interrupt TF1_VECTOR {
 }
 
 /*------------------------------------------------------------------------------
-Triggers on message transmission from keyboard, indicating change of state.
-Since serial port is configured in 9-bit multiprocess communication mode.
-Each message consists of two messages. First one contains address of the 
-recipient microcontroller, second one the actual message. 
-After reading the address addressed microcontroller changes SM2 to 0.
+Processes a message from keyboard or LCD, indicating change of state.
+Called from the main loop for every message taken out of the receive queue.
 ------------------------------------------------------------------------------*/
-void SIO_int(void) interrupt SIO_VECTOR {
-	EA = 0;
-	
-	while(RI != 1) {;} /* Wait until the recieving concludes */
-	RI = 0; /* Reset recieving bit */
-		
-	if(SM2 == 1) {
-		if(SBUF == COMM_ID) SM2 = 0;
-		EA = 1;
-		return;
-	}
-	
-	SM2 = 1;
-	
-	if (SBUF == COMM_RESET) {
+static void process_message(unsigned char message) {
+	if (message == COMM_RESET) {
 		timer = 0;
 		TR0 = 0; /* Turn off Timer 0 */
 		TR1 = 0; /* Turn off Timer 1 */
@@ -77,20 +63,18 @@ void SIO_int(void) interrupt SIO_VECTOR {
 	} else if(seg_bar() != 0 && seg_bar()) {
 			timer = 1;
 			seg_loading_inc();
-	} else if(SBUF == COMM_NO_TIMER) {
+	} else if(message == COMM_NO_TIMER) {
 		timer = 0;
 		TR0 = 1; /* Turn on Timer 0 */
 		TR1 = 1; /* Turn on Timer 1 */
-	} else if(SBUF == COMM_TIMER) {
+	} else if(message == COMM_TIMER) {
 		timer = 1;
 		TR0 = 1; /* Turn on Timer 0 */
 		TR1 = 1; /* Turn on Timer 1 */
-	} else if(SBUF == COMM_TIMER_INC) {
+	} else if(message == COMM_TIMER_INC) {
 		timer = 1;
 		seg_loading_inc();
 	}	
-	
-	EA = 1;
 }
 
 /*------------------------------------------------
@@ -98,7 +82,9 @@ The main C function.
 ------------------------------------------------*/
 void main(void) {
 	
-	comm_init(); /* Initialise the serial port */
+	comm_init(COMM_ID, COMM_TIMER_2, COMM_TIMER_NONE); /* Initialise the serial port, timer 1 drives the display, */
+	                                                   /* 7SEG never starts a conversation */
+	comm_subscribe(RESET_GROUP);
 	ES = 1; /* Enable serial interrupts */
 	
 	/*------------------------------------------------
@@ -109,8 +95,8 @@ void main(void) {
 	------------------------------------------------*/
 	TMOD |= 0x01; /* Mode 1: 16bit counter */
 	ET0 = 1; /* Enable timer 0 interrupt */
-	TH0 = 0x00; /* Set value for 8 higher bits */
-	TL1 = 0x00; /* Set value for 8 lower bits */
+	TH0 = BLINK_RELOAD >> 8; /* Set value for 8 higher bits */
+	TL0 = BLINK_RELOAD & 0xFF; /* Set value for 8 lower bits */
 	TR0 = 0;
 	
 	/*------------------------------------------------
@@ -123,13 +109,15 @@ void main(void) {
 	------------------------------------------------*/
 	TMOD |= 0x20; /* Mode 2: Auto-reload */
 	ET1 = 1; /* Enable timer 1 interrupt */
-	TH1 = 0x00; /* Set 8 bit value for auto-reload */
-	TL1 = 0x00; /* Initialize the timer */
+	TH1 = MUX_RELOAD; /* Set 8 bit value for auto-reload */
+	TL1 = MUX_RELOAD; /* Initialize the timer */
 	TR1 = 0;
 	
 	EA = 1; /* Enable global interrupts */
 	
 	seg_init();
 	
-	while(1) {;}
+	while(1) {
+		if(comm_available()) process_message(comm_read());
+	}
 }
\ No newline at end of file
@@ -15,6 +15,11 @@ ID of microcontroller used in communication
 ------------------------------------------------*/
 #define COMM_ID 1
 
+/*------------------------------------------------
+Groups the microcontroller subscribes to
+------------------------------------------------*/
+#define RESET_GROUP (COMM_GROUP | 0x01) /* Reset together with the mixer */
+
 /*------------------------------------------------
 List of possible communication messages
 received in the serial port
@@ -30,11 +30,73 @@ Definition of LCD commands in 8-bit mode
 #define DISPLAY_OFF 0x08
 #define DISPLAY_ON 0x0C
 #define FUNCTION_SET 0x28 /* Sets LCD into 4 rows with 5x8 dots for each character */
+#define SET_CGRAM_ADDR 0x40 /* Following characters are written into CGRAM from given address */
+
+#define BUSY_TIMEOUT 255 /* Polls of the busy flag before giving up (roughly 5ms at 12MHz) */
+
+/*------------------------------------------------
+Set DDRAM address commands of the first column
+of each row. Rows 0 and 2, as well as rows 1
+and 3 follow each other in DDRAM.
+------------------------------------------------*/
+static unsigned char code ROW_ADDR[LCD_ROW_COUNT] = {0x80, 0xC0, 0x90, 0xD0};
+
+/*------------------------------------------------
+Rows of pixels of LCD_GLYPH_BAR(1) up to
+LCD_GLYPH_BAR(5), the lowest row is left
+for the cursor.
+------------------------------------------------*/
+static unsigned char code BAR_GLYPHS[5][8] = {
+	{0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00},
+	{0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00},
+	{0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x00},
+	{0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x00},
+	{0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x00}
+};
+
+/*------------------------------------------------------------------------------
+lcd_write_ functions and lcd_clear() only change the shadow buffer, which holds
+the characters the screen should display. Every changed cell is marked dirty
+and lcd_commit() sends only the dirty cells to the LCD.
+Cells are indexed row by row: cell = row * LCD_COLUMN_COUNT + column.
+------------------------------------------------------------------------------*/
+static unsigned char idata SHADOW[LCD_CELL_COUNT]; /* Characters the screen should display */
+static unsigned char data DIRTY[LCD_CELL_COUNT / 8]; /* One bit per cell, set if the LCD doesn't display it yet */
+static bit DIRTY_ANY; /* Stores whether any bit in DIRTY is set */
+static bit VISIBLE; /* Stores whether the display is on, nothing is committed while it is off */
+
+/*------------------------------------------------
+Waits until the LCD has finished the previous
+command by reading the busy flag on D7.
+In 4-bit mode the flag comes with the higher
+nibble, the lower nibble must be read as well.
+Gives up after BUSY_TIMEOUT polls, so that
+a missing LCD can't hang the microcontroller.
+------------------------------------------------*/
+static void lcd_wait(void) {
+	unsigned char i;
+	bit busy = 1;
+
+	PORT |= 0x0F; /* Release data bits, so that the LCD can drive them */
+	RS = 0;
+	RW = 1;
+
+	for(i = 0; i < BUSY_TIMEOUT && busy == 1; i++) {
+		E = 1; /* Read higher nibble */
+		busy = D7;
+		E = 0;
+		E = 1; /* Read lower nibble */
+		E = 0;
+	}
+
+	RW = 0;
+}
 
 /*------------------------------------------------
 Sends given 8-bit command, using 4-bit mode.
 ------------------------------------------------*/
 static void lcd_send_cmd(unsigned char cmd) {	
+	lcd_wait();
 	RS = 0;
 	RW = 0;
 	
@@ -55,6 +117,7 @@ The function is semantically the same as lcd_send_cmd(char)
 except it sets RS to 1.
 ------------------------------------------------*/
 static void lcd_send_char(unsigned char c) {
+	lcd_wait();
 	RS = 1;
 	RW = 0;
 	
@@ -69,12 +132,39 @@ static void lcd_send_char(unsigned char c) {
 	E = 0; /* Finish sending data */
 }
 
+/*------------------------------------------------
+Stores a character in the shadow buffer and
+marks the cell dirty if it has changed.
+------------------------------------------------*/
+static void shadow_put(unsigned char c, unsigned char cell) {
+	if(SHADOW[cell] == c) return;
+
+	SHADOW[cell] = c;
+	DIRTY[cell >> 3] |= (1 << (cell & 7));
+	DIRTY_ANY = 1;
+}
+
+/*------------------------------------------------
+Writes the rows of the glyph into CGRAM, which
+leaves the address counter pointing into CGRAM.
+lcd_commit() always starts by setting a DDRAM
+address, so it can't write there by accident.
+------------------------------------------------*/
+void lcd_define_glyph(unsigned char index, unsigned char* rows) {
+	unsigned char i;
+
+	lcd_send_cmd(SET_CGRAM_ADDR | ((index & 0x07) << 3));
+	for(i = 0; i < 8; i++) lcd_send_char(rows[i]);
+}
+
 /*------------------------------------------------
 Initializes LCD to work in 4-bit mode,
 turns it on and declares ready for receiving
 characters to display on screen.
 ------------------------------------------------*/
 void lcd_init(void) {
+	unsigned char i;
+
 	PORT = 0x00; /* Clear all data bits */
 	
 	/*------------------------------------------------
@@ -89,42 +179,52 @@ void lcd_init(void) {
 	lcd_send_cmd(FUNCTION_SET);
 	lcd_send_cmd(DISPLAY_ON);
 	lcd_send_cmd(ENTRY_MODE_SET);
+	VISIBLE = 1;
+
+	for(i = 0; i < 5; i++) lcd_define_glyph(LCD_GLYPH_BAR(i + 1), BAR_GLYPHS[i]);
+
+	/*------------------------------------------------
+	Clear the screen once, from now on the shadow
+	buffer matches it. Next command waits until
+	the clearing is done.
+	------------------------------------------------*/
+	lcd_send_cmd(CLEAR_DISPLAY);
+
+	for(i = 0; i < LCD_CELL_COUNT; i++) SHADOW[i] = ' ';
+	for(i = 0; i < LCD_CELL_COUNT / 8; i++) DIRTY[i] = 0;
+	DIRTY_ANY = 0;
 }
 
 /*------------------------------------------------
 Turns on display, doesn't configure anything.
+Cells changed while the display was off are sent
+first, so that no outdated characters show up.
 ------------------------------------------------*/
 void lcd_on(void) {
+	VISIBLE = 1;
+	lcd_commit(LCD_CELL_COUNT);
 	lcd_send_cmd(DISPLAY_ON);
 }
 
 /*------------------------------------------------
 Turns off display, no data is lost.
+From now on changes only stay in the shadow
+buffer, until the display is turned on.
 ------------------------------------------------*/
 void lcd_off(void) {
+	VISIBLE = 0;
 	lcd_send_cmd(DISPLAY_OFF);
 }
 
 /*------------------------------------------------
-Clears screen of any characters
+Clears screen of any characters.
+Cells which already hold a space aren't sent
+again, so clearing doesn't make the screen blink.
 ------------------------------------------------*/
 void lcd_clear(void) {
-	unsigned char i = 0;
-	lcd_send_cmd(CLEAR_DISPLAY);
-	
-	for(i = 0; i < 100; i++) {;} 	/* since clearing takes a while, wait */
-}
+	unsigned char i;
 
-/*------------------------------------------------
-Before any lcd_write_ can start sending characters
-to LCD, cursor must be set to an index where 
-the first character will be written.
-------------------------------------------------*/
-static void cursor_set(unsigned char row, unsigned char column) {
-	if(row == 0) lcd_send_cmd(0x80 + column);
-	else if(row == 1) lcd_send_cmd(0xc0 + column);
-	else if(row == 2) lcd_send_cmd(0x90 + column);
-	else lcd_send_cmd(0xd0 + column);
+	for(i = 0; i < LCD_CELL_COUNT; i++) shadow_put(' ', i);
 }
 
 /*------------------------------------------------
@@ -134,8 +234,7 @@ Provading incorrect indexes will result in character
 being displayed at unexpected places.
 ------------------------------------------------*/
 void lcd_write_char_at(unsigned char c, unsigned char row, unsigned char column) {
-	cursor_set(row, column);
-	lcd_send_char(c);
+	shadow_put(c, row * LCD_COLUMN_COUNT + column);
 }
 
 /*------------------------------------------------
@@ -148,9 +247,50 @@ The function doesn't verify if array is null terminated
 and if the array won't overflow the row.
 ------------------------------------------------*/
 void lcd_write_arr_at(unsigned char* arr, unsigned char row, unsigned char column) {
-	cursor_set(row, column);
+	unsigned char cell = row * LCD_COLUMN_COUNT + column;
+
 	while(*arr != 0) {
-		lcd_send_char(*arr);
+		shadow_put(*arr, cell);
 		arr++;
+		cell++;
 	}
-}
\ No newline at end of file
+}
+
+/*------------------------------------------------
+Sends dirty cells in order of their index.
+DDRAM address increments after every written
+character, so a set DDRAM address command is only
+sent when the next dirty cell doesn't follow the
+last written one.
+Sent cells are no longer dirty, so once the
+budget runs out the next call simply carries on
+with the remaining ones.
+------------------------------------------------*/
+void lcd_commit(unsigned char budget) {
+	unsigned char i;
+	unsigned char mask;
+	unsigned char cell;
+	unsigned char addr;
+	unsigned char cursor = 0; /* Set DDRAM address command of the next write, 0 if unknown */
+
+	if(DIRTY_ANY == 0 || VISIBLE == 0) return;
+
+	for(i = 0; i < LCD_CELL_COUNT / 8; i++) {
+		if(DIRTY[i] == 0) continue;
+
+		for(mask = 0x01, cell = i * 8; mask != 0; mask <<= 1, cell++) {
+			if((DIRTY[i] & mask) == 0) continue;
+			if(budget == 0) return; /* Rest is sent by the next call */
+
+			addr = ROW_ADDR[cell / LCD_COLUMN_COUNT] + cell % LCD_COLUMN_COUNT;
+			if(addr != cursor) lcd_send_cmd(addr);
+			lcd_send_char(SHADOW[cell]);
+			cursor = addr + 1;
+
+			DIRTY[i] &= ~mask;
+			budget--;
+		}
+	}
+
+	DIRTY_ANY = 0;
+}
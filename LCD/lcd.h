@@ -9,6 +9,9 @@ LCD   - Liquid Crystal Display
 DDRAM - Display Data Remote Access Memory. Stores characters that are being
 		displayed on the LCD. To change displayed characters, change values
 		of addressable units in DDRAM. For exact addresses refer to documentation.
+
+lcd_clear() and lcd_write_ functions don't talk to the LCD. They change a shadow
+copy of the screen, which lcd_commit() then sends to DDRAM, only where it differs.
 ------------------------------------------------------------------------------*/
 
 /*------------------------------------------------
@@ -24,6 +27,15 @@ and number of rows of said columns in the LCD.
 ------------------------------------------------*/
 #define LCD_COLUMN_COUNT 16
 #define LCD_ROW_COUNT 4
+#define LCD_CELL_COUNT (LCD_COLUMN_COUNT * LCD_ROW_COUNT)
+
+/*------------------------------------------------
+Glyphs defined by lcd_init(). LCD_GLYPH_BAR(n)
+is a cell with n <1, 5> of its 5 columns of
+pixels filled from the left, which allows bars
+to grow by a column of pixels at a time.
+------------------------------------------------*/
+#define LCD_GLYPH_BAR(n) (n)
 
 /*------------------------------------------------
 Initializes the LCD and static variables.
@@ -35,10 +47,24 @@ LCD is initialized into 4-bit mode with
 ------------------------------------------------*/
 void lcd_init(void);
 
+/*------------------------------------------------
+Defines a custom character in CGRAM, where
+index - character code of the glyph <0, 7>
+rows - 8 rows of pixels from the top, lowest
+       5 bits of each row are its pixels
+
+Cells already displaying the character change
+right away. Character 0 can't be written with
+lcd_write_arr_at(), as it ends the string.
+------------------------------------------------*/
+void lcd_define_glyph(unsigned char index, unsigned char* rows);
+
 /*------------------------------------------------
 Turns on the display. Doesn't impact any data 
 in the display. Only makes the screen
 display characters.
+Before that sends every cell which has changed
+while the display was off.
 ------------------------------------------------*/
 void lcd_on(void);
 
@@ -46,16 +72,18 @@ void lcd_on(void);
 Turns off the display. Doesn't impact any data 
 in the display. Only makes the screen not
 display characters.
+While the display is off lcd_commit() doesn't
+send anything, changes are kept until lcd_on().
 ------------------------------------------------*/
 void lcd_off(void);
 
 /*------------------------------------------------
 Removes all characters from the screen.
-Specifically sets all DDRAM addresses to character
+Specifically sets all cells to character
 of space (' '), so that they appear empty.
-Continious calling of lcd_clear() and
-any of lcd_write_ functions may cause the
-screen to blink and appear to stutter.
+Redrawing a screen with lcd_clear() followed by
+lcd_write_ functions only sends the characters
+which have changed, once lcd_commit() is called.
 ------------------------------------------------*/
 void lcd_clear(void);
 
@@ -70,8 +98,8 @@ column - indicates index of character in line <0,15>
  3 | | | | | | | | | | | | | | | | |
 (rows) 
  
-More precisely writes into specific address
-of DDRAM. Other DDRAM addresses will not be changed.
+The character appears on the screen once
+lcd_commit() is called. Other cells will not be changed.
 To avoid having leftovers from earlier message(s)
 use lcd_clear() to overwrite all addresses,
 so they appear empty. (they are set to a space: ' ')
@@ -89,15 +117,25 @@ column - indicates index of character in line <0,15>
  3 | | | | | | | | | | | | | | | | |
 (rows) 
  
-More precisely writes into specific addresses
-of DDRAM. Any not explicitly overwritten
-addresses will not be changed.
+The characters appear on the screen once
+lcd_commit() is called. Any not explicitly
+overwritten cells will not be changed.
 To avoid having leftovers from earlier message(s)
 use lcd_clear() to overwrite all addresses, so
 they appear empty. (they are set to a space: ' ')
 ------------------------------------------------*/
 void lcd_write_arr_at(char* arr, unsigned char row, unsigned char column);
 
+/*------------------------------------------------
+Sends cells changed since they were last sent to
+DDRAM, at most budget of them. Consecutive
+changed cells are sent with a single cursor move.
+Calling it with a small budget regularly spreads
+a redraw of the whole screen over several calls.
+LCD_CELL_COUNT as the budget sends all of them.
+------------------------------------------------*/
+void lcd_commit(unsigned char budget);
+
 /*------------------------------------------------
 END: #ifndef __LCD_H__
 ------------------------------------------------*/
@@ -7,205 +7,303 @@ LM041L liquid crystal display. (LMO41L will be referred from now on as "LCD")
 
 #include <REGX52.H> /* Special function register declarations */
 
-#include <STDIO.H> /* sprintf() */
-
 #include "main.h"
 
 #include "lcd.h" /* LCD control */
 
 #include "../lib/comm.h" /* Serial communication control */
 
+#include "../lib/timing.h" /* Reload values of the timers */
+
 static volatile unsigned char data state;
-static unsigned char data loading_progress; 
+static unsigned char data loading_bar; /* Column of the LCD bar currently filling */
+static unsigned char data loading_fill; /* Columns of pixels filled in loading_bar */
 static unsigned char data seg_progress;
+static unsigned long data tick_cycles; /* Machine cycles counted by timer 2 towards the next second */
 
 /*------------------------------------------------------------------------------
-All the globals below will be changed with interrupt routine. 
-Either by a timer or a serial interrupt. The structure of code guarantees 
-these globals will never be changed outside of normal scope of code.
-Thus allowing us to not mark them as volatile.
+All the globals below are only changed in the main loop, interrupt routines
+merely raise the flags declared after them. Thus allowing us to not mark
+them as volatile.
 ------------------------------------------------------------------------------*/
-static unsigned int data timer; /* Stores timer value input by user (in minutes) */
-static unsigned int data cur_timer; /* Stores minutes left until the timer concludes */
-static unsigned int data cur_seconds; /* Stores the value of last minute in timer in seconds */
+static unsigned int data timer; /* Stores timer value input by user (in minutes), composed by keyboard */
+static unsigned char data clock[4]; /* Stores time left until the timer concludes, as packed BCD */
+static unsigned long data timer_span; /* Length of the timer in seconds */
+static long data bar_left; /* Seconds times LOADING_STEPS left until the next LCD step fills */
+static long data seg_left; /* Seconds times SEG_BARS left until the next 7SEG bar fills */
 static unsigned char data speed_mode; /* Current speed mode of the mixer */
 static bit data display_state; /* Stores whether display is on (1) or off (0) */
-static bit data timer_0_state; /* Stores if current interrupt of timer is odd */
+
+static volatile bit data tick; /* Set by timer 2 every tick */
+static volatile unsigned char data seconds_passed; /* Increased by timer 2 once a second passes, until the main loop counts it down */
+static volatile bit data display_toggle; /* Set by external interrupt 1 on button press */
+
+/*------------------------------------------------------------------------------
+Indexes of clock, hours take two bytes so that the longest timer fits,
+65535 minutes are 1092 hours
+------------------------------------------------------------------------------*/
+#define CLOCK_HUNDREDS 0 /* Thousands and hundreds of hours */
+#define CLOCK_HOURS 1
+#define CLOCK_MINUTES 2
+#define CLOCK_SECONDS 3
+
+/* Column of each byte of clock in "HHHH:MM:SS" */
+static unsigned char code clock_column[] = {0, 2, 5, 8};
+
+/*------------------------------------------------------------------------------
+Dynamic fields of the screens, drawn by draw_field(). Their place is taken
+from the layout of the screen displayed last.
+------------------------------------------------------------------------------*/
+#define FIELD_NONE 0 /* Item is a static text */
+#define FIELD_SPEED 1 /* "x" - value of chosen speed mode */
+#define FIELD_TIMER 2 /* "x" - currently input timer, up to 5 digits */
+#define FIELD_CLOCK 3 /* "HHHH:MM:SS" - hours, minutes and seconds left from the timer, */
+                      /* leading zeros of hours above two digits are left blank */
+#define FIELD_COUNT 4
+
+static unsigned char data field_row[FIELD_COUNT]; /* Row of each field on the current screen */
+static unsigned char data field_column[FIELD_COUNT]; /* Column of each field on the current screen */
+
+/*------------------------------------------------------------------------------
+Item of a screen layout, either a static text or a dynamic field written at
+row and column. Layouts are stored in code memory and end with LAYOUT_END.
+------------------------------------------------------------------------------*/
+struct item {
+	unsigned char row;
+	unsigned char column;
+	unsigned char field;
+	char code* text;
+};
+
+#define TEXT(row, column, text) {row, column, FIELD_NONE, text}
+#define FIELD(row, column, field) {row, column, field, 0}
+#define ROW_END 0xFF /* Row of the item ending a layout */
+#define LAYOUT_END {ROW_END, 0, FIELD_NONE, 0}
 
 /*------------------------------------------------------------------------------
 Displays a welcome message onto the display of LCD.
-"PRESS ANY KEY"
-"TO START"
 ------------------------------------------------------------------------------*/
-static void display_welcome(void) {
-	lcd_clear();
-	lcd_write_arr_at("PRESS ANY KEY", 1, 1);
-	lcd_write_arr_at("TO START", 2, 4);
-}
+static struct item code screen_welcome[] = {
+	TEXT(1, 1, "PRESS ANY KEY"),
+	TEXT(2, 4, "TO START"),
+	LAYOUT_END
+};
 
 /*------------------------------------------------------------------------------
-Displays a message onto the display of LCD, prompting user to enter a
-numerical value for the speed mode the motor will operate in.
-"ENTER ROTATION"
-"MODE"
-"(FROM 0 TO 9)"
+Prompts user to enter a numerical value for the speed mode the motor
+will operate in.
 ------------------------------------------------------------------------------*/
-static void display_select_speed(void) {
-	lcd_clear();
-	lcd_write_arr_at("ENTER ROTATION", 0, 1);
-	lcd_write_arr_at("MODE", 1, 6);
-	lcd_write_arr_at("(FROM 0 TO 9)", 2, 2);	
-}
+static struct item code screen_select_speed[] = {
+	TEXT(0, 1, "ENTER ROTATION"),
+	TEXT(1, 6, "MODE"),
+	TEXT(2, 2, "(FROM 0 TO 9)"),
+	LAYOUT_END
+};
 
 /*------------------------------------------------------------------------------
-Displays a message onto the display of LCD, prompting user to decide
-whether they want to run the mixer with timer or without. 
+Prompts user to decide whether they want to run the mixer with timer or without.
 '0' - means with a timer
 default - everything else means without a timer
-"DO YOU WANT TO"
-"SET A MIX TIMER"
-"0 - YES"
-"DEFAULT - NO"
 ------------------------------------------------------------------------------*/
-static void display_select_mode(void) {
-	lcd_clear();
-	lcd_write_arr_at("DO YOU WANT TO", 0, 0);
-	lcd_write_arr_at("SET A MIX TIMER", 1, 0);
-	lcd_write_arr_at("0 - YES", 2, 0);
-	lcd_write_arr_at("DEFAULT - NO", 3, 0);
-}
+static struct item code screen_select_mode[] = {
+	TEXT(0, 0, "DO YOU WANT TO"),
+	TEXT(1, 0, "SET A MIX TIMER"),
+	TEXT(2, 0, "0 - YES"),
+	TEXT(3, 0, "DEFAULT - NO"),
+	LAYOUT_END
+};
 
 /*------------------------------------------------------------------------------
 After the user decides that they don't want the timer, this will be the screen
 they will see until they terminate the mixing.
-"SPEED MODE: x" - where x is replaced by the value of chosen speed mode
-"TIMER: OFF"
-
-DO NOT call this function when speed mode is updated, use update_speed(void) instead.
 ------------------------------------------------------------------------------*/
-static void display_no_timer(void) {
-	lcd_clear();
-	lcd_write_arr_at("SPEED MODE: ", 0, 0);
-	lcd_write_char_at(speed_mode, 0, 12);
-	lcd_write_arr_at("TIMER: OFF", 1, 0);
-	lcd_write_arr_at("PRESS # TO END", 3, 0);
-}
-
-static void update_speed(void) {
-	lcd_write_char_at(speed_mode, 0, 12);
-}
+static struct item code screen_no_timer[] = {
+	TEXT(0, 0, "SPEED MODE: "),
+	FIELD(0, 12, FIELD_SPEED),
+	TEXT(1, 0, "TIMER: OFF"),
+	TEXT(3, 0, "PRESS # TO END"),
+	LAYOUT_END
+};
 
 /*------------------------------------------------------------------------------
 After the user decides that they do want the timer, this will be the screen
 they will see until they confirm their input timer length. Timer length is input
 in minutes.
-"TIMER VALUE (MIN)
-"x" - where x is currently input timer
-"* TO DELETE"
-"# TO CONFIRM"
+------------------------------------------------------------------------------*/
+static struct item code screen_enter_timer[] = {
+	TEXT(0, 0, "SET TIMER (MIN)"),
+	FIELD(1, 0, FIELD_TIMER),
+	TEXT(2, 0, "* TO DELETE"),
+	TEXT(3, 0, "# TO CONFIRM"),
+	LAYOUT_END
+};
 
-DO NOT call this function when the input timer is changed,
-use update_enter_timer(void) instead.
+/*------------------------------------------------------------------------------
+After the timer is set, this will be the visible screen until the timer runs out.
+"[..............]" - progression bar of the timer,
+										 once a progress is made '.' is filled column by column
 ------------------------------------------------------------------------------*/
-static void display_enter_timer(void) {
-	unsigned char s[6]; /* 5 is the maximum number of digits an unsigned int can hold */
-	sprintf(s, "%u", timer);
-	lcd_clear();
-	lcd_write_arr_at("SET TIMER (MIN)", 0, 0);
-	lcd_write_arr_at(s, 1, 0);
-	lcd_write_arr_at("* TO DELETE", 2, 0);
-	lcd_write_arr_at("# TO CONFIRM", 3, 0);
+static struct item code screen_timer[] = {
+	TEXT(0, 0, "SPEED MODE: "),
+	FIELD(0, 12, FIELD_SPEED),
+	TEXT(1, 0, "TIMER:"),
+	FIELD(1, 6, FIELD_CLOCK), /* Ends at the last column */
+	TEXT(2, 0, "[..............]"),
+	TEXT(3, 0, "PRESS # TO END"),
+	LAYOUT_END
+};
+
+/*------------------------------------------------------------------------------
+After the timer runs out user is prompted to press # to reset the device.
+------------------------------------------------------------------------------*/
+static struct item code screen_timer_end[] = {
+	TEXT(0, 0, "TIMER ENDED"),
+	TEXT(1, 0, "PRESS #"),
+	LAYOUT_END
+};
+
+/*------------------------------------------------------------------------------
+Converts a value <0, 99> into packed BCD.
+Only called once the timer is confirmed.
+------------------------------------------------------------------------------*/
+static unsigned char to_bcd(unsigned char value) {
+	return ((value / 10) << 4) | (value % 10);
 }
 
 /*------------------------------------------------------------------------------
-Changes the value of the timer displayed on display_enter_timer(void) when 
-the user modifies it in any way with the keyboard.
+Writes both digits of clock[i] at their place in FIELD_CLOCK.
+The shadow buffer of the LCD leaves out a digit that hasn't changed.
 ------------------------------------------------------------------------------*/
-static void update_enter_timer(void) {
-		unsigned char s[6] = {' ',' ',' ',' ',' ',0}; /* 5 is the maximum number of digits an unsigned int can hold */
-		lcd_write_arr_at(s, 1, 0);
-		sprintf(s, "%u", timer);
-		lcd_write_arr_at(s, 1, 0);
+static void write_clock(unsigned char i) {
+	unsigned char column = field_column[FIELD_CLOCK] + clock_column[i];
+	unsigned char high = '0' + (clock[i] >> 4);
+	unsigned char low = '0' + (clock[i] & 0x0F);
+	
+	if(i == CLOCK_HUNDREDS) { /* Leading zeros are blank */
+		if(high == '0') high = ' ';
+		if(high == ' ' && low == '0') low = ' ';
+	}
+	lcd_write_char_at(high, field_row[FIELD_CLOCK], column);
+	lcd_write_char_at(low, field_row[FIELD_CLOCK], column + 1);
 }
 
 /*------------------------------------------------------------------------------
-After the timer is set, this will be the visible screen until the timer runs out.
-"SPEED MODE: x" - where x is replaced by the value of chosen speed mode
-"TIMER: HH:MM:SS" - where HH:MM:SS are hours, minutes and seconds left from the timer
-"[..............]" - progression bar of the timer,
-										 once a progress is made '.' is changed to '='
+Decreases the clock by a second, borrowing from minutes and hours.
+The clock must not be zero. Returns index of the highest part which changed,
+so that only the parts from it to seconds have to be written.
+------------------------------------------------------------------------------*/
+static unsigned char clock_tick(void) {
+	unsigned char i = CLOCK_SECONDS;
+	
+	while(clock[i] == 0x00) { /* Borrow */
+		clock[i] = (i == CLOCK_HOURS) ? 0x99 : 0x59;
+		i--;
+	}
+	
+	if((clock[i] & 0x0F) == 0) clock[i] -= 0x07; /* x0 -> (x-1)9 */
+	else clock[i]--;
+	return i;
+}
 
-DO NOT call this function when the value of the timer is changed (a second passes),
-use update_timer(void) instead.
+/*------------------------------------------------------------------------------
+Draws the current value of a dynamic field at its place on the screen.
+Also used to update a field once its value changes, without redrawing
+the whole screen.
 ------------------------------------------------------------------------------*/
-static void display_timer(void) {
-	unsigned char s[9];
-	sprintf(s, "%02u:%02u:%02u", timer/60, timer%60, 0);
-	lcd_clear();
-	lcd_write_arr_at("SPEED MODE: ", 0, 0);
-	lcd_write_char_at(speed_mode, 0, 12);
-	lcd_write_arr_at("TIMER: ", 1, 0);
-	lcd_write_arr_at(s, 1, 7);
-	lcd_write_arr_at("[..............]", 2, 0);
-	lcd_write_arr_at("PRESS # TO END", 3, 0);
+static void draw_field(unsigned char field) {
+	unsigned char row = field_row[field];
+	unsigned char column = field_column[field];
+	unsigned char s[6];
+	unsigned char i;
+	unsigned int value;
+	
+	if(field == FIELD_SPEED) {
+		lcd_write_char_at(speed_mode, row, column);
+		
+	} else if(field == FIELD_TIMER) {
+		/* Digits are produced from the lowest one */
+		value = timer;
+		i = 5;
+		s[5] = 0;
+		do {
+			i--;
+			s[i] = '0' + value % 10;
+			value /= 10;
+		} while(value != 0);
+		lcd_write_arr_at("     ", row, column); /* Timer has up to 5 digits */
+		lcd_write_arr_at(s + i, row, column);
+		
+	} else if(field == FIELD_CLOCK) {
+		lcd_write_arr_at("    :  :  ", row, column);
+		for(i = CLOCK_HUNDREDS; i <= CLOCK_SECONDS; i++) write_clock(i);
+	}
 }
 
 /*------------------------------------------------------------------------------
-After the timer runs out user is prompted to press # to reset the device.
-"TIMER ENDED"
-"PRESS #"
+Displays a screen from its layout. Texts are written in order of the layout,
+the shadow buffer of the LCD then only sends what differs from the previous
+screen, with the fewest cursor moves.
 ------------------------------------------------------------------------------*/
-static void display_timer_end(void) {
+static void display(struct item code* layout) {
 	lcd_clear();
-	lcd_write_arr_at("TIMER ENDED", 0, 0);
-	lcd_write_arr_at("PRESS #", 1, 0);
+	while(layout->row != ROW_END) {
+		if(layout->field == FIELD_NONE) {
+			lcd_write_arr_at(layout->text, layout->row, layout->column);
+		} else {
+			field_row[layout->field] = layout->row;
+			field_column[layout->field] = layout->column;
+			draw_field(layout->field);
+		}
+		layout++;
+	}
 }
 
 /*------------------------------------------------------------------------------
-Changes the value of the timer displayed on display_timer(void) after a
+Changes the value of the timer displayed on screen_timer after a
 quantum of time passes. (one second)
+Step k out of LOADING_STEPS fills once elapsed seconds times LOADING_STEPS
+reach k times timer_span, so the last one fills with the last second.
+Rather than computing the fraction every second, bar_left keeps the difference
+of both sides and is only decreased each second and increased by timer_span
+once a step fills. Same for the bars of 7SEG.
+Each step fills one more column of pixels in a single cell of the LCD bar.
 ------------------------------------------------------------------------------*/
 static void update_timer(void) {
-	unsigned char s[9];
-	float perc;
+	unsigned char i;
 	
-	if(cur_seconds == 0 && cur_timer == 0) {
-		TR0 = 0;
+	if((clock[CLOCK_HUNDREDS] | clock[CLOCK_HOURS] | clock[CLOCK_MINUTES] | clock[CLOCK_SECONDS]) == 0) {
 		state = STATE_TIMER_END;
-		display_timer_end();
-		comm_send(MTR_ID, COMM_TIMER_END);
-		comm_send(MTR_ID, COMM_TIMER_END);
+		display(screen_timer_end);
+		lcd_commit(LCD_CELL_COUNT); /* Show the end before waiting for the acknowledgement */
+		comm_send_ack(MTR_ID, COMM_TIMER_END);
 		return;
 	}
 	
-	if(cur_seconds != 0) cur_seconds--;
-	else if(cur_timer != 0) {
-		cur_timer--;
-		cur_seconds = 59;
-	}
-	sprintf(s, "%02u:%02u:%02u", cur_timer/60, cur_timer%60, cur_seconds);
-	lcd_write_arr_at(s, 1, 7);
+	for(i = clock_tick(); i <= CLOCK_SECONDS; i++) write_clock(i);
 	
-	perc = timer-cur_timer;
-	perc = perc - (float)(cur_seconds)/60;
-	perc = perc/timer;
-	if(perc > 0.0714*(loading_progress+1)) { /* 0.0714 == 1/14   */
-                                             /* There is 14 bars */
-		loading_progress++;
-		lcd_write_char_at('=', 2, loading_progress);
+	bar_left -= LOADING_STEPS;
+	while(bar_left <= 0) { /* Short timers fill more than one step a second */
+		bar_left += timer_span;
+		if(loading_fill == LOADING_FILLS) {
+			loading_bar++;
+			loading_fill = 0;
+		}
+		loading_fill++;
+		lcd_write_char_at(LCD_GLYPH_BAR(loading_fill), 2, loading_bar);
 	}
 	
-	if(perc > 0.1666*(seg_progress+1)) { /* 0.1666 == 1/6 */
-                                         /* 7SEG increments it's bars, there is 6 bars in 7SEG */
+	seg_left -= SEG_BARS; /* 7SEG increments its bars */
+	if(seg_left <= 0) {
+		seg_left += timer_span;
 		seg_progress++;
 		comm_send(SEG_ID, COMM_TIMER_INC);
 	}
 }
 
 /*------------------------------------------------------------------------------
-On button press turn on/off the display.
+Turns on/off the display.
 ------------------------------------------------------------------------------*/
-void IE1_int(void) interrupt IE1_VECTOR {
+static void toggle_display(void) {
 	if(display_state == 1) {
 		lcd_off();
 	} else {
@@ -215,50 +313,58 @@ void IE1_int(void) interrupt IE1_VECTOR {
 }
 
 /*------------------------------------------------------------------------------
-This timer overflows every second. It is used for measuring when timer concludes.
+On button press request the display to be turned on/off.
+The LCD is only accessed from the main loop.
+------------------------------------------------------------------------------*/
+void IE1_int(void) interrupt IE1_VECTOR {
+	display_toggle = 1;
+}
+
+/*------------------------------------------------------------------------------
+This timer counts down the silence on the bus before the LCD talks,
+started and stopped by comm.c.
 ------------------------------------------------------------------------------*/
 void TF0_int(void) interrupt TF0_VECTOR {
-	TR0 = 0; /* Stop timer 0 */
-	TF0 = 0; /* Reset overflow flag */
-	TH0 = 0x00; /* Reset value for 8 higher bits */
-	TL0 = 0x00; /* Reset value for 8 lower bits */
-	
-	timer_0_state = ~timer_0_state;
-	if(timer_0_state == 0) update_timer();
-	
-	TR0 = 1;
+	comm_arb_int();
 }
 
 /*------------------------------------------------------------------------------
-Triggers on message transmission from keyboard, indicating change of state.
-Since serial port is configured in 9-bit multiprocess communication mode.
-Each message consists of two messages. First one contains address of the 
-recipient microcontroller, second one the actual message. 
-After reading the address addressed microcontroller changes SM2 to 0.
+This timer overflows every tick, reloading itself, so no cycles are lost between
+ticks. It is used for pacing the LCD and for measuring when timer concludes.
+Seconds are counted by adding up TICK_CYCLES against CYCLES_PER_SECOND, so that
+rounding of TICK_CYCLES doesn't accumulate.
+The countdown itself is updated in the main loop.
 ------------------------------------------------------------------------------*/
-void SIO_int(void) interrupt SIO_VECTOR {
-	while(RI != 1) {;} /* Wait until the recieving concludes */
-	RI = 0; /* Reset recieving bit */
-		
-	if(SM2 == 1) {
-		if(SBUF == COMM_ID) SM2 = 0;
-		return;
+void TF2_int(void) interrupt TF2_VECTOR {
+	TF2 = 0; /* Reset overflow flag */
+	
+	tick = 1;
+	tick_cycles += TICK_CYCLES;
+	if(tick_cycles >= CYCLES_PER_SECOND) {
+		tick_cycles -= CYCLES_PER_SECOND; /* Keep the remainder for the next second */
+		seconds_passed++;
 	}
-	SM2 = 1;
+}
 
+/*------------------------------------------------------------------------------
+Processes a message from keyboard, indicating change of state.
+Called from the main loop for every message taken out of the receive queue.
+------------------------------------------------------------------------------*/
+static void process_message(unsigned char message) {
 	if(state == STATE_STANDBY) {
+		if(message == COMM_RESET) return; /* Repeat of the reset, not a key */
 		state = STATE_SELECT_SPEED;
-		display_select_speed();
+		display(screen_select_speed);
 		
 	} else if(state == STATE_SELECT_SPEED) {
 		state = STATE_SELECT_MODE;
-		display_select_mode();
-		speed_mode = SBUF;
+		display(screen_select_mode);
+		speed_mode = message;
 		
 	} else if(state == STATE_SELECT_MODE) {
-		if(SBUF != '0') {
+		if(message != '0') {
 			state = STATE_NO_TIMER;
-			display_no_timer();
+			display(screen_no_timer);
 			
 			/* Inform SEG and MOTOR to start working */
 			comm_send(SEG_ID, SEG_NO_TIMER);
@@ -266,51 +372,61 @@ void SIO_int(void) interrupt SIO_VECTOR {
 		} else {
 			state = STATE_ENTER_TIMER;
 			timer = 0;
-			cur_seconds = 0;
-			display_enter_timer();
+			display(screen_enter_timer);
 		}
 		
 	} else if(state == STATE_NO_TIMER || state == STATE_TIMER) {
-		if(SBUF == COMM_RESET) {
-			TR0 = 0; /* Stop timer 0 */
+		if(message == COMM_RESET) {
 			state = STATE_STANDBY;
-			display_welcome();
+			display(screen_welcome);
 			return;
 		}
-		speed_mode = SBUF;
-		update_speed();
+		speed_mode = message + '0'; /* Speed mode is sent as a number to SPEED_GROUP */
+		draw_field(FIELD_SPEED);
 		
 	} else if(state == STATE_ENTER_TIMER) {
-			if(SBUF == '*') {
-				timer /= 10;
-				update_enter_timer();
-			} else if(SBUF == '#') {
+			if(message != COMM_TIMER && message != COMM_TIMER_SHOW) return;
+			
+			/* Value follows in the same burst, so it has already arrived */
+			timer = (unsigned int)comm_read() << 8;
+			timer |= comm_read();
+			
+			if(message == COMM_TIMER_SHOW) {
+				draw_field(FIELD_TIMER);
+			} else {
 				state = STATE_TIMER;
-				cur_timer = timer;
-				timer_0_state = 0;
-				loading_progress = 0;
+				clock[CLOCK_HUNDREDS] = to_bcd(timer / 60 / 100);
+				clock[CLOCK_HOURS] = to_bcd(timer / 60 % 100);
+				clock[CLOCK_MINUTES] = to_bcd(timer % 60);
+				clock[CLOCK_SECONDS] = 0x00;
+				loading_bar = 1;
+				loading_fill = 0;
 				seg_progress = 0;
-				cur_seconds = 0;
-				TMOD |= 0x01; /* Mode 1: 16bit counter */
-				TH0 = 0xFF; /* Set value for 8 higher bits */
-				TL0 = 0xF0; /* Set value for 8 lower bits */
-				ET0 = 1; /* Enable timer 0 interrupt */
-				TR0 = 1; /* Start timer 0 */
-				display_timer();
+				timer_span = (unsigned long)timer * 60;
+				bar_left = timer_span;
+				seg_left = timer_span;
+				
+				/*------------------------------------------------
+				Count the first second from now.
+				------------------------------------------------*/
+				TR2 = 0; /* Stop timer 2 */
+				TF2 = 0; /* Drop a tick which might be pending */
+				TH2 = TICK_RELOAD >> 8; /* Set value for 8 higher bits */
+				TL2 = TICK_RELOAD & 0xFF; /* Set value for 8 lower bits */
+				tick_cycles = 0;
+				seconds_passed = 0;
+				TR2 = 1; /* Start timer 2 */
+				
+				display(screen_timer);
 				
 				/* Inform SEG and MOTOR to start working */
 				comm_send(SEG_ID, SEG_TIMER);
 				comm_send(MTR_ID, speed_mode-'0');
-			} else {
-				if((timer-'0'+SBUF)*10/10 != timer-'0'+SBUF) return;
-				timer = timer*10 + SBUF - '0';
-				update_enter_timer();
 			}
 	} else if(state == STATE_TIMER_END) {
-			if(SBUF == COMM_RESET) {
-				TR0 = 0; /* Stop timer 0 */
+			if(message == COMM_RESET) {
 				state = STATE_STANDBY;
-				display_welcome();
+				display(screen_welcome);
 				return;
 			}
 	}
@@ -325,13 +441,44 @@ void main(void) {
 	
 	lcd_init();
 	
-	comm_init(); /* Initialize serial communication port */
+	comm_init(COMM_ID, COMM_TIMER_1, COMM_TIMER_0); /* Initialize serial communication port */
+	comm_subscribe(RESET_GROUP | SPEED_GROUP);
 	ES = 1; /* Enable serial interrupt */
 	
+	/*------------------------------------------------
+	Timer 2 generates the ticks.
+	------------------------------------------------*/
+	T2CON = 0x00; /* 16-bit auto-reload, not used for the baud rate */
+	RCAP2H = TICK_RELOAD >> 8; /* Set value for 8 higher bits */
+	RCAP2L = TICK_RELOAD & 0xFF; /* Set value for 8 lower bits */
+	TH2 = TICK_RELOAD >> 8; /* Initialize the timer */
+	TL2 = TICK_RELOAD & 0xFF; /* Initialize the timer */
+	ET2 = 1; /* Enable timer 2 interrupt */
+	TR2 = 1; /* Start timer 2 */
+	
 	IT1 = 1; /* Send interrupt 1, only on falling edge H->L */
 	EX1 = 1; /* Enable external interrupt 1 */
 	EA = 1; /* Enable global interrupts */
 	
-	display_welcome();
-	while(1){;}
+	display(screen_welcome);
+	while(1) {
+		if(comm_available()) process_message(comm_read());
+		
+		if(seconds_passed != 0) { /* Seconds missed while the loop was held up are caught up one at a time */
+			ET2 = 0;
+			seconds_passed--;
+			ET2 = 1;
+			if(state == STATE_TIMER) update_timer();
+		}
+		
+		if(display_toggle == 1) {
+			display_toggle = 0;
+			toggle_display();
+		}
+		
+		if(tick == 1) {
+			tick = 0;
+			lcd_commit(RENDER_BUDGET); /* Show a part of whatever has changed on the screen */
+		}
+	}
 }
\ No newline at end of file
@@ -15,6 +15,12 @@ ID of microcontroller used in communication
 ------------------------------------------------*/
 #define COMM_ID 2
 
+/*------------------------------------------------
+Groups the microcontroller subscribes to
+------------------------------------------------*/
+#define RESET_GROUP (COMM_GROUP | 0x01) /* Reset together with the mixer */
+#define SPEED_GROUP (COMM_GROUP | 0x02) /* Follow the speed mode */
+
 /*------------------------------------------------
 IDs of other microcontrollers
 ------------------------------------------------*/
@@ -27,9 +33,12 @@ List of possible communication messages
 received in the serial port
 ------------------------------------------------*/
 #define COMM_RESET 0xFF /* Reset the state of the microcontroller */
-#define COMM_DELETE 0x0A /* Remove last digit of current timer value */
-#define COMM_CONFIRM 0x0B /* Confirm currently set value for timer */
+#define COMM_TIMER 0x02 /* Confirm the timer, followed by its value */
+#define COMM_TIMER_SHOW 0x04 /* Display the timer being entered, followed by its value */
+						/* Value is in minutes, sent as 8 higher bits and 8 lower bits */
+						/* in the same burst */
 /* - */ /* Message with numercial value of currently pressed key on keyboard */
+/* - */ /* Message with numercial value of currently selected speed mode (sent to SPEED_GROUP) */
 
 /*------------------------------------------------
 List of possible communication messages
@@ -40,6 +49,22 @@ sent through the serial port.
 #define COMM_TIMER_INC 0x03 /* Another 16.66% of timer has passed, increase LOADING_BAR */
 #define COMM_TIMER_END 0x0A /* The timer has concluded */
 
+/*------------------------------------------------
+Number of characters sent to the LCD every tick,
+so that redrawing the whole screen doesn't hold
+off processing of messages
+------------------------------------------------*/
+#define RENDER_BUDGET 8
+
+/*------------------------------------------------
+Number of bars the progress of the timer is
+split into on each display
+------------------------------------------------*/
+#define LOADING_BARS 14 /* Bars of LOADING_BAR on the LCD */
+#define LOADING_FILLS 5 /* Each LCD bar fills one column of pixels at a time */
+#define LOADING_STEPS (LOADING_BARS * LOADING_FILLS)
+#define SEG_BARS 6 /* Bars of LOADING_BAR on the 7SEG */
+
 /*------------------------------------------------
 Declaration of states of the program
 ------------------------------------------------*/
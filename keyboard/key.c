@@ -10,128 +10,187 @@ Source file with implementations of functions controlling the keyboard.
 
 #define KEYBOARD P2 /* Keyboard port */
 
+#define KEY_COUNT 12
+#define ROW_COUNT 4 /* Rows are read on P2_4 - P2_7 */
+#define COLUMN_COUNT 3 /* Columns are driven on P2_3, P2_2 and P2_1 */
+
+/*------------------------------------------------
+Every key has its own integrating debouncer.
+Each scan its level moves one step towards
+the sampled state, only once it reaches 0 or
+DEBOUNCE the change is reported.
+Highest bit of the state stores the reported
+state of the key.
+------------------------------------------------*/
+#define DEBOUNCE 4 /* Scans a key must be stable for */
+#define LEVEL 0x7F /* Level of the debouncer */
+#define DOWN 0x80 /* Key is reported as pressed */
+
+#define EVENT_SIZE 8 /* Capacity of the event queue, must be a power of 2 */
+
+#if KEY_REPEAT_DELAY > 127 || KEY_REPEAT_FIRST > 127 || KEY_REPEAT_MIN > KEY_REPEAT_FIRST
+#error "Repeat timing does not fit the 8 bit scan counter"
+#endif
+
 /*------------------------------------------------
-Definition of keyboard columns, which
-key_scan() iterates on
+Port values driving a single column low, while
+rows are kept high so that they can be read.
+Keyboard works on negative logic.
+
+| | |
+1 2 3
+4 5 6
+7 8 9
+* 0 #
+| | |
+
 ------------------------------------------------*/
-#define COLUMN_1 P2_3
-#define COLUMN_2 P2_2
-#define COLUMN_3 P2_1 
+static unsigned char code COLUMN_DRIVE[COLUMN_COUNT] = {0xF7, 0xFB, 0xFD};
 
-static unsigned char LAST_SCANNED; /* Stores last scanned key, to detect whether a key is being held down */
+static unsigned char code KEY_AT[ROW_COUNT][COLUMN_COUNT] = {
+	{KEY_1, KEY_2, KEY_3},
+	{KEY_4, KEY_5, KEY_6},
+	{KEY_7, KEY_8, KEY_9},
+	{KEY_STAR, KEY_0, KEY_HASH}
+};
+
+static unsigned char code KEY_CHAR[KEY_COUNT] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '*', '#'};
+
+static unsigned char idata KEY_STATE[KEY_COUNT]; /* Debouncer level and reported state of each key */
+
+static unsigned char idata EVENTS[EVENT_SIZE]; /* Events waiting for key_read() */
+static volatile unsigned char data EVENT_HEAD; /* Index at which key_scan() stores the next event */
+static volatile unsigned char data EVENT_TAIL; /* Index of the next event for key_read() */
+
+/*------------------------------------------------
+Times are kept as values of SCANS, compared by
+their signed difference, so the counter may
+wrap around.
+------------------------------------------------*/
+static unsigned char data SCANS; /* Count of scans, timestamp of the current one */
+static volatile bit REPEAT; /* Stores whether auto-repeat is enabled */
+static unsigned char data REPEAT_KEY; /* Held key which repeats, KEY_NULL if none */
+static unsigned char data REPEAT_AT; /* Scan at which REPEAT_KEY repeats next */
+static unsigned char data REPEAT_PERIOD; /* Scans until the repeat after the next one */
 
 /*------------------------------------------------
-Initializes LAST_SCANNED
-to its starting value KEY_NULL.
+Releases all keys and empties the event queue.
 ------------------------------------------------*/
 void key_init(void) {
-	LAST_SCANNED = KEY_NULL;
+	unsigned char i;
+	
+	for(i = 0; i < KEY_COUNT; i++) KEY_STATE[i] = 0;
+	EVENT_HEAD = 0;
+	EVENT_TAIL = 0;
+	
+	SCANS = 0;
+	REPEAT = 0;
+	REPEAT_KEY = KEY_NULL;
 }
 
 /*------------------------------------------------
-Keyboard works on negative logic, so no current
-means a key is pressed. 
-If a key has been pressed change state of 
-LAST_SCANNED. As long as pressed
-key == LAST_SCANNED return KEY_NULL to prevent
-sending multiple signals on key hold.
+Queues an event, if the queue is full the event
+is lost.
 ------------------------------------------------*/
-unsigned char key_scan(void) {
+static void key_event(unsigned char event) {
+	if(((EVENT_HEAD + 1) & (EVENT_SIZE - 1)) == EVENT_TAIL) return;
 	
-	unsigned char pressed_key = KEY_NULL;
-	
-	/*------------------------------------------------
-	Scanning column 1 
+	EVENTS[EVENT_HEAD] = event;
+	EVENT_HEAD = (EVENT_HEAD + 1) & (EVENT_SIZE - 1);
+}
+
+/*------------------------------------------------
+Drives every column low in turn and samples all
+rows of it at once, so any number of keys can be
+held together.
+The last pressed digit or '*' repeats, '#' never
+does, as it confirms the entered value.
+------------------------------------------------*/
+void key_scan(void) {
+	unsigned char column;
+	unsigned char row;
+	unsigned char rows;
+	unsigned char key;
+	unsigned char state;
 	
-	|
-	1 2 3
-	4 5 6
-	7 8 9
-	* 0 #
-	|
+	SCANS++;
 	
-	------------------------------------------------*/
-	COLUMN_1 = 0; /* Keyboard works on negative logic */
-	COLUMN_2 = 1;
-	COLUMN_3 = 1;
-	if(KEYBOARD == 0xE7) { /* '1' */
-		pressed_key = KEY_1;
-	} else if(KEYBOARD == 0xD7) { /* '4' */
-		pressed_key = KEY_4;
-	} else if(KEYBOARD == 0xB7) { /* '7' */
-		pressed_key = KEY_7;
-	} else if(KEYBOARD == 0x77) { /* '*' */
-		pressed_key = KEY_STAR;
+	for(column = 0; column < COLUMN_COUNT; column++) {
+		KEYBOARD = COLUMN_DRIVE[column];
+		rows = (~KEYBOARD >> 4) & 0x0F; /* Bit of every row with a pressed key is set */
+		
+		for(row = 0; row < ROW_COUNT; row++) {
+			key = KEY_AT[row][column];
+			state = KEY_STATE[key];
+			
+			if((rows & 0x01) != 0) {
+				if((state & LEVEL) < DEBOUNCE) state++;
+			} else {
+				if((state & LEVEL) != 0) state--;
+			}
+			
+			if((state & LEVEL) == DEBOUNCE && (state & DOWN) == 0) {
+				state |= DOWN;
+				key_event(key);
+				
+				if(REPEAT && key != KEY_HASH) {
+					REPEAT_KEY = key;
+					REPEAT_AT = SCANS + KEY_REPEAT_DELAY;
+					REPEAT_PERIOD = KEY_REPEAT_FIRST;
+				}
+			} else if((state & LEVEL) == 0 && (state & DOWN) != 0) {
+				state &= ~DOWN;
+				key_event(key | KEY_RELEASED);
+				
+				if(key == REPEAT_KEY) REPEAT_KEY = KEY_NULL;
+			}
+			
+			KEY_STATE[key] = state;
+			rows >>= 1;
+		}
 	}
 	
-	/*------------------------------------------------
-	Scanning column 2 
-	
-	  |
-	1 2 3
-	4 5 6
-	7 8 9
-	* 0 #
-	  |
+	KEYBOARD = 0xFF; /* Stop driving the columns */
 	
-	------------------------------------------------*/
-	COLUMN_1 = 1;
-	COLUMN_2 = 0; /* Keyboard works on negative logic */
-	COLUMN_3 = 1;
-	if(KEYBOARD == 0xEB) { /* '2' */
-		pressed_key = KEY_2;
-	} else if(KEYBOARD == 0xDB) { /* '5' */
-		pressed_key = KEY_5;
-	} else if(KEYBOARD == 0xBB) { /* '8' */
-		pressed_key = KEY_8;
-	} else if(KEYBOARD == 0x7B) { /* '0' */
-		pressed_key = KEY_0;
+	if(REPEAT_KEY == KEY_NULL) return;
+	if(!REPEAT) {
+		REPEAT_KEY = KEY_NULL;
+		return;
 	}
 	
-	/*------------------------------------------------
-	Scanning column 3
-	
-	    |
-	1 2 3
-	4 5 6
-	7 8 9
-	* 0 #
-	    |
-	
-	------------------------------------------------*/
-	COLUMN_1 = 1;
-	COLUMN_2 = 1; 
-	COLUMN_3 = 0; /* Keyboard works on negative logic */
-	if(KEYBOARD == 0xED) { /* '3' */
-		pressed_key = KEY_3;
-	} else if(KEYBOARD == 0xDD) { /* '6' */
-		pressed_key = KEY_6;
-	} else if(KEYBOARD == 0xBD) { /* '9' */
-		pressed_key = KEY_9;
-	} else if(KEYBOARD == 0x7D) { /* '#' */
-		pressed_key = KEY_HASH;
+	if((signed char)(SCANS - REPEAT_AT) >= 0) {
+		key_event(REPEAT_KEY);
+		REPEAT_AT += REPEAT_PERIOD;
+		if(REPEAT_PERIOD >= KEY_REPEAT_MIN + KEY_REPEAT_STEP) REPEAT_PERIOD -= KEY_REPEAT_STEP;
+		else REPEAT_PERIOD = KEY_REPEAT_MIN;
 	}
+}
+
+/*------------------------------------------------
+The queue is only written by key_scan() and only
+read here, so no interrupt has to be disabled.
+------------------------------------------------*/
+unsigned char key_read(void) {
+	unsigned char event;
 	
-	if(pressed_key == LAST_SCANNED) return KEY_NULL;
-	LAST_SCANNED = pressed_key;
-	return pressed_key;
+	if(EVENT_TAIL == EVENT_HEAD) return KEY_NULL;
+	event = EVENTS[EVENT_TAIL];
+	EVENT_TAIL = (EVENT_TAIL + 1) & (EVENT_SIZE - 1);
+	return event;
+}
+
+/*------------------------------------------------
+Bit is written at once, so key_scan() never sees
+it half changed.
+------------------------------------------------*/
+void key_repeat(bit enable) {
+	REPEAT = enable;
 }
 
 /*------------------------------------------------
 If provided key is not a valid key, returns 0
 ------------------------------------------------*/
 unsigned char key_to_char(unsigned char key) {
-	if(key == KEY_0) return '0';
-	if(key == KEY_1) return '1';
-	if(key == KEY_2) return '2';
-	if(key == KEY_3) return '3';
-	if(key == KEY_4) return '4';
-	if(key == KEY_5) return '5';
-	if(key == KEY_6) return '6';
-	if(key == KEY_7) return '7';
-	if(key == KEY_8) return '8';
-	if(key == KEY_9) return '9';
-	if(key == KEY_STAR) return '*';
-	if(key == KEY_HASH) return '#';
-	return 0;
+	if(key >= KEY_COUNT) return 0;
+	return KEY_CHAR[key];
 }
\ No newline at end of file
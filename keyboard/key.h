@@ -14,7 +14,7 @@ Include macro guard
 /*------------------------------------------------
 Definition of every single key on keyboard.
 ------------------------------------------------*/
-#define KEY_NULL -1 /* Symbolizes no key being pressed */
+#define KEY_NULL 0xFF /* Symbolizes no key being pressed, keys are stored as unsigned char */
 #define KEY_0 0
 #define KEY_1 1
 #define KEY_2 2
@@ -28,6 +28,22 @@ Definition of every single key on keyboard.
 #define KEY_STAR 10 /* '*' key */
 #define KEY_HASH 11 /* '#' key */
 
+#define KEY_RELEASED 0x80 /* Set in the event of a released key */
+
+/*------------------------------------------------
+Auto-repeat of held digits and '*', counted in
+calls of key_scan(). After the delay the first
+repeat period is used, every repeat shortens
+the period by the step, down to the minimum.
+Values must not exceed 127. Scanned at 200 Hz
+the first repeat comes after 0.5 s, then they
+speed up from 5 to 25 a second.
+------------------------------------------------*/
+#define KEY_REPEAT_DELAY 100 /* Scans from the press to the first repeat */
+#define KEY_REPEAT_FIRST 40 /* Scans between the first two repeats */
+#define KEY_REPEAT_STEP 4 /* Scans taken off the period by every repeat */
+#define KEY_REPEAT_MIN 8 /* Shortest period between repeats */
+
 /*------------------------------------------------
 Initializes static variables.
 Must be called before using any functions from
@@ -36,15 +52,31 @@ key.h
 void key_init(void);
 
 /*------------------------------------------------
-Returns the currently pressed key. 
-If a key is being held, function returns 
-the key upon press detection and then KEY_NULL
-until another key is pressed.
+Scans the whole keyboard once and queues an event
+for every key which has been pressed or released.
+A key must keep its state for a few scans before
+the change is reported, which debounces it.
+Must be called periodically, only from one place.
+------------------------------------------------*/
+void key_scan(void);
+
+/*------------------------------------------------
+Returns the oldest queued event, or KEY_NULL if
+there is none. An event is the key, with
+KEY_RELEASED set if the key has been released.
+------------------------------------------------*/
+unsigned char key_read(void);
+
+/*------------------------------------------------
+Enables or disables auto-repeat. While enabled
+a held digit or '*' queues its press again and
+again, faster the longer it is held. Enabling
+applies from the next press, disabling at once.
 ------------------------------------------------*/
-unsigned char key_scan(void);
+void key_repeat(bit enable);
 
 /*------------------------------------------------
-Converts value returned by key_scan to a
+Converts a key returned by key_read to a
 character representing pressed key.
 ------------------------------------------------*/
 unsigned char key_to_char(unsigned char key);
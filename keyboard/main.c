@@ -13,7 +13,54 @@ keyboard.
 
 #include "../lib/comm.h" /* Serial communication control */
 
+#include "../lib/timing.h" /* Reload values of the timers */
+
 static unsigned char data state;
+static unsigned int data timer; /* Timer being entered (in minutes) */
+static unsigned int data timer_shown; /* Timer value displayed by LCD */
+
+/*------------------------------------------------------------------------------
+This timer overflows SCAN_HZ times a second and scans the keyboard, so the scan
+rate doesn't depend on how long the main loop waits for the bus.
+Found keys are queued as events until the main loop takes them.
+------------------------------------------------------------------------------*/
+void TF0_int(void) interrupt TF0_VECTOR {
+	TH0 = SCAN_RELOAD >> 8; /* Reset value for 8 higher bits */
+	TL0 = SCAN_RELOAD & 0xFF; /* Reset value for 8 lower bits */
+	
+	key_scan();
+}
+
+/*------------------------------------------------------------------------------
+This timer counts down the silence on the bus before the keyboard talks,
+started and stopped by comm.c.
+------------------------------------------------------------------------------*/
+void TF2_int(void) interrupt TF2_VECTOR {
+	comm_arb_int();
+}
+
+/*------------------------------------------------
+Sends the timer to LCD, with its value in
+the same burst, so both arrive together.
+------------------------------------------------*/
+static void send_timer(unsigned char message) {
+	unsigned char buf[3];
+	
+	buf[0] = message;
+	buf[1] = timer >> 8;
+	buf[2] = timer & 0xFF;
+	comm_send_burst(LCD_ID, buf, 3);
+}
+
+/*------------------------------------------------
+Sends a message to a group twice, as group
+messages can't be acknowledged. Every member
+handles the repeat harmlessly.
+------------------------------------------------*/
+static void send_group(unsigned char group, unsigned char message) {
+	comm_send(group, message);
+	comm_send(group, message);
+}
 
 /*------------------------------------------------
 The main C function.
@@ -25,49 +72,77 @@ void main(void) {
 	
 	key_init(); /* Initialize keyboard */
 	
-	comm_init(); /* Initialize serial communication port */
+	comm_init(COMM_ID, COMM_TIMER_1, COMM_TIMER_2); /* Initialize serial communication port */
 	ES = 1; /* Enable serial interrupt */
+	
+	/*------------------------------------------------
+	Initialize timer 0 in 16 bit counter mode.
+	------------------------------------------------*/
+	TMOD = (TMOD & 0xF0) | 0x01; /* Mode 1: 16bit counter */
+	TH0 = SCAN_RELOAD >> 8; /* Set value for 8 higher bits */
+	TL0 = SCAN_RELOAD & 0xFF; /* Set value for 8 lower bits */
+	ET0 = 1; /* Enable timer 0 interrupt */
+	TR0 = 1; /* Start timer 0 */
+	
 	EA = 1; /* Enable global interrupts */
 	
 	while(1) {
-		c = key_scan();
-		if(c != KEY_NULL) {
-			if(state == STATE_STANDBY) {
+		c = key_read();
+		if(c == KEY_NULL) {
+			/*------------------------------------------------
+			Keys are all handled, so a burst of them, such as
+			a held key repeating, is echoed only once.
+			------------------------------------------------*/
+			if(state == STATE_ENTER_TIMER && timer != timer_shown) {
+				send_timer(COMM_TIMER_SHOW);
+				timer_shown = timer;
+				continue;
+			}
+			PCON |= 0x01; /* Idle until the next interrupt */
+			continue;
+		}
+		if((c & KEY_RELEASED) != 0) continue; /* Only presses are acted on */
+		
+		if(state == STATE_STANDBY) {
+				comm_send(LCD_ID, key_to_char(c));
+				state = STATE_SELECT_SPEED;
+		} else if(state == STATE_SELECT_SPEED) {
+				if(c == KEY_STAR || c == KEY_HASH) continue;
+				state = STATE_SELECT_MODE;
+				comm_send(LCD_ID, key_to_char(c));
+		} else if(state == STATE_SELECT_MODE) {
+				if(c != KEY_0) {
+					state = STATE_NO_TIMER;
 					comm_send(LCD_ID, key_to_char(c));
-					state = STATE_SELECT_SPEED;
-			} else if(state == STATE_SELECT_SPEED) {
-					if(c == KEY_STAR || c == KEY_HASH) continue;
-					state = STATE_SELECT_MODE;
+				} else {
+					state = STATE_ENTER_TIMER;
+					timer = 0;
+					timer_shown = 0; /* LCD starts entry from 0 */
+					key_repeat(1); /* Digits and '*' repeat while held */
 					comm_send(LCD_ID, key_to_char(c));
-			} else if(state == STATE_SELECT_MODE) {
-					if(c != KEY_0) {
-						state = STATE_NO_TIMER;
-						comm_send(LCD_ID, key_to_char(c));
-					} else {
-						state = STATE_ENTER_TIMER;
-						comm_send(LCD_ID, key_to_char(c));
-					}
-			} else if(state == STATE_NO_TIMER || state == STATE_TIMER) {
-					if(c == KEY_STAR) continue;
-					if(c == KEY_HASH) {
-						comm_send(SEG_ID, COMM_RESET);
-						comm_send(MTR_ID, COMM_RESET);
-						comm_send(LCD_ID, COMM_RESET);
-						comm_send(SEG_ID, COMM_RESET);
-						comm_send(MTR_ID, COMM_RESET);
-						state = STATE_STANDBY;
-					} else {
-						comm_send(MTR_ID, key_to_char(c)-'0');
-						comm_send(LCD_ID, key_to_char(c));
-						comm_send(MTR_ID, key_to_char(c)-'0');
-					}
-			} else if(state == STATE_ENTER_TIMER) {
-					c = key_to_char(c);
-					if(c ==  '#') {
-						state = STATE_TIMER;
-					}
-					comm_send(LCD_ID, c);
-			}
+				}
+		} else if(state == STATE_NO_TIMER || state == STATE_TIMER) {
+				if(c == KEY_STAR) continue;
+				if(c == KEY_HASH) {
+					send_group(RESET_GROUP, COMM_RESET);
+					state = STATE_STANDBY;
+				} else {
+					send_group(SPEED_GROUP, key_to_char(c)-'0');
+				}
+		} else if(state == STATE_ENTER_TIMER) {
+				/*------------------------------------------------
+				The timer is composed here and LCD only displays
+				it, the final value is sent once confirmed.
+				------------------------------------------------*/
+				if(c == KEY_HASH) {
+					state = STATE_TIMER;
+					key_repeat(0);
+					send_timer(COMM_TIMER);
+				} else if(c == KEY_STAR) {
+					timer /= 10;
+				} else if(timer <= (TIMER_MAX - c) / 10) { /* Keep the timer under TIMER_MAX, digit keys are their values */
+					timer = timer*10 + c;
+				}
 		}
 	}
 }
\ No newline at end of file
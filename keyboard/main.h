@@ -22,20 +22,32 @@ IDs of other microcontrollers
 #define LCD_ID 2
 #define MTR_ID 3
 
+/*------------------------------------------------
+Groups of microcontrollers, a message sent
+to a group reaches all of its members at once
+------------------------------------------------*/
+#define RESET_GROUP (COMM_GROUP | 0x01) /* SEG, LCD and MOTOR, reset together with the mixer */
+#define SPEED_GROUP (COMM_GROUP | 0x02) /* LCD and MOTOR, follow the speed mode */
+
 /*------------------------------------------------
 List of possible communication messages
 sent through the serial port
 ------------------------------------------------*/
-#define COMM_RESET 0xFF /* Reset the state of the microcontroller */
+#define COMM_RESET 0xFF /* Reset the state of the microcontroller (sent twice to RESET_GROUP) */
 #define COMM_NO_TIMER 0x01 /* Mixer has started without a timer */
 #define COMM_TIMER 0x02 /* Mixer has started with a timer */
 						/* Next 2 message will contain timer value in minutes */
 						/* First message is 8higher bits, second message is 8 lower bits */
 #define COMM_TIMER_INC 0x03 /* Another 16.66% of timer has passed, increase LOADING_BAR */
-#define COMM_DELETE 0x0A /* Remove last digit of current timer value */
-#define COMM_CONFIRM 0x0B /* Confirm currently set value for timer */
+#define COMM_TIMER_SHOW 0x04 /* Timer being entered has changed, followed by its value like COMM_TIMER */
 /* - */ /* Message with numercial value of currently pressed key on keyboard */
-/* - */ /* Message with numercial value of currently selected speed mode */
+/* - */ /* Message with numercial value of currently selected speed mode (sent twice to SPEED_GROUP) */
+
+/*------------------------------------------------
+Longest timer in minutes, the largest value
+sent in 16 bits
+------------------------------------------------*/
+#define TIMER_MAX 65535U
 
 /*------------------------------------------------
 Declaration of states of the program
@@ -11,23 +11,449 @@ the the serial communcation port.
 
 #include "comm.h"
 
+/*------------------------------------------------
+Capacity of the transmit queue in bytes.
+Must be a power of 2, one byte is always
+kept empty to tell a full queue from an empty one.
+Every queued conversation takes its number of
+message frames, its address and the messages.
+------------------------------------------------*/
+#define TX_SIZE 16
+
+/*------------------------------------------------
+Capacity of the receive queue.
+Same rules as for TX_SIZE apply.
+------------------------------------------------*/
+#define RX_SIZE 16
+
+/*------------------------------------------------
+Layout of the address frame.
+Lower nibble holds the address of the recipient,
+or the recipient groups if bit 7 (COMM_GROUP)
+is set. Bits 4 and 5 hold the kind of the
+conversation. If bit 6 is set, the conversation
+carries a burst of messages instead of one.
+Acknowledged conversations can't be bursts, so
+that combination marks a resynchronisation.
+------------------------------------------------*/
+#define ADDR_MASK 0x0F
+#define KIND_MASK 0x30
+#define KIND_MESSAGE 0x00 /* Address is followed by the message */
+#define KIND_ACK_REQ 0x10 /* Address is followed by a header and the message, */
+                          /* the recipient must acknowledge it */
+#define KIND_ACK 0x20 /* Address is followed by the acknowledged header */
+#define KIND_DIAG 0x30 /* Address is followed by the address which asks for the counters */
+#define BURST 0x40 /* Address is followed by the number of messages and the messages */
+#define SYNC (KIND_ACK_REQ | BURST) /* Address is followed by a header, the recipient forgets */
+                                  /* the last header of the sender and acknowledges it */
+
+/*------------------------------------------------
+What the receiver expects in the next
+message frame of the conversation.
+------------------------------------------------*/
+#define RX_IDLE 0 /* Not addressed, nothing */
+#define RX_HEADER 1 /* Header of an acknowledged message */
+#define RX_LENGTH 2 /* Number of messages in a burst */
+#define RX_DATA 3 /* One of RX_LEFT messages */
+#define RX_ACK 4 /* Acknowledged header */
+#define RX_DIAG 5 /* Address which asks for the counters */
+#define RX_SYNC 6 /* Header of a resynchronisation */
+
+#define DIAG_NONE 0xFF /* Nobody asked for the counters */
+#define STAT_BYTES (COMM_STAT_COUNT * 2) /* Size of the counters in bytes */
+
+/*------------------------------------------------
+Header sent before each acknowledged message.
+Higher nibble holds address of the sender,
+lower nibble the sequence number of the message.
+The acknowledgement carries the same header,
+except with the address of the recipient.
+Sequence numbers are counted separately for each
+recipient, as each recipient only remembers the
+last header from every sender.
+------------------------------------------------*/
+#define HEADER(addr, seq) (((addr) << 4) | ((seq) & 0x0F))
+#define HEADER_ADDR(header) ((header) >> 4)
+
+#define NODE_COUNT 4 /* Number of microcontrollers on the bus */
+#define ACK_NONE 0xFF /* No acknowledgement has been received */
+
+/*------------------------------------------------
+Number of times an acknowledged message is sent
+again before comm_send_ack() gives up and number
+of polls spent waiting for the acknowledgement
+after each try. The acknowledgement takes two
+frames once the recipient's serial interrupt has
+queued it, which can be held up by another
+interrupt like the pauses GAP_CYCLES covers.
+One more frame is allowed as a margin.
+------------------------------------------------*/
+#define ACK_RETRIES 3
+#define ACK_POLL_CYCLES 20 /* Machine cycles of one poll in comm_exchange() */
+#define ACK_TIMEOUT (((2 + 1) * SLOT_CYCLES + GAP_CYCLES) / ACK_POLL_CYCLES + 1)
+
+/*------------------------------------------------
+Listen-before-talk arbitration.
+Before taking the bus a microcontroller waits
+until it has been idle for GAP_CYCLES and then
+for COMM_ADDR + 1 more slots, so when several
+start waiting at once the lowest address wins
+and the others see its address frame in time.
+GAP_CYCLES covers the longest pause between
+frames of one conversation, when the serial
+interrupt is held up by another interrupt.
+After releasing the bus a microcontroller waits
+NODE_COUNT more slots, letting everyone else
+talk before it speaks again.
+Acknowledgements and counters skip arbitration,
+the bus is handed to them by the conversation
+which asked for them.
+
+The wait is timed in the background by the
+arbitration timer, in 16-bit mode as a single
+count, restarted by every frame on the bus.
+------------------------------------------------*/
+#define GAP_CYCLES 500 /* Machine cycles */
+#define SLOT_CYCLES (11UL * CYCLES_PER_SECOND / COMM_BAUD) /* Machine cycles of one frame */
+
+#if GAP_CYCLES + 2 * NODE_COUNT * SLOT_CYCLES > 65536
+#error "COMM_BAUD is too low for the arbitration timer with this F_OSC"
+#endif
+
+/*------------------------------------------------
+Ends a conversation this microcontroller has been
+listening to. While it waits for the bus it keeps
+SM2 at 0, so every frame on the bus restarts
+the arbitration timer.
+------------------------------------------------*/
+#define RX_UNADDRESSED() { SM2 = !TX_WAIT; }
+
+/*------------------------------------------------
+Appends a byte to the transmit queue.
+Serial interrupt must be disabled and the queue
+must have room for it. It is a macro, so that
+it can be used both in and outside of the
+serial interrupt.
+------------------------------------------------*/
+#define TX_PUT(value) { TX_QUEUE[TX_HEAD] = (value); TX_HEAD = (TX_HEAD + 1) & (TX_SIZE - 1); }
+#define TX_ROOM ((TX_TAIL - TX_HEAD - 1) & (TX_SIZE - 1)) /* Number of free bytes in the transmit queue */
+
+static unsigned char data COMM_ADDR; /* Address of this microcontroller */
+static unsigned char data COMM_GROUPS; /* Groups this microcontroller is subscribed to */
+
+static unsigned char idata TX_QUEUE[TX_SIZE]; /* Queued conversations waiting for the transmitter */
+static volatile unsigned char data TX_HEAD; /* Index at which the next byte will be queued */
+static volatile unsigned char data TX_TAIL; /* Index of the next byte to be transmitted */
+static volatile unsigned char data TX_LEFT; /* Number of message frames left in the current conversation */
+static volatile bit TX_BUSY; /* Stores whether the transmitter is shifting out a frame */
+static unsigned char idata TX_SEQ[NODE_COUNT]; /* Sequence number of the last acknowledged message sent to each recipient */
+static unsigned char data TX_SYNCED; /* Bit for each recipient which has been resynchronised since comm_init() */
+static bit TX_DIAG; /* Stores whether the current conversation streams the counters */
+static bit TX_DEFER; /* Stores whether this microcontroller has just released the bus */
+static volatile bit TX_WAIT; /* Stores whether queued conversations wait for the bus */
+
+static unsigned char data ARB_TIMER; /* Timer counting down the arbitration, COMM_TIMER_ */
+static unsigned int data ARB_RELOAD; /* Reload of the arbitration timer */
+static unsigned int data ARB_DEFER_RELOAD; /* Reload of the arbitration timer after releasing the bus */
+static unsigned int data ARB_NEXT; /* Reload the arbitration timer is started with */
+
+static unsigned char idata RX_MESSAGE[RX_SIZE]; /* Received messages waiting for comm_read() */
+static volatile unsigned char data RX_HEAD; /* Index at which the serial interrupt stores the next message */
+static volatile unsigned char data RX_TAIL; /* Index of the next message returned by comm_read() */
+static unsigned char data RX_STATE; /* What the next message frame contains */
+static unsigned char data RX_LEFT; /* Number of messages left in the current conversation */
+static unsigned char data RX_STORE; /* Index at which the next message of the conversation is stored */
+static unsigned char data RX_ACK_HEADER; /* Header of the acknowledged message being received */
+static bit RX_ACKED; /* Stores whether the current conversation must be acknowledged */
+static bit RX_DROP; /* Stores whether the current conversation is dropped */
+static unsigned char idata RX_SEQ[NODE_COUNT]; /* Header of the last acknowledged message from each sender */
+static volatile unsigned char data ACK_HEADER; /* Header of the last acknowledgement received */
+
+static unsigned int idata COMM_STATS[COMM_STAT_COUNT]; /* Bus counters, indexed by COMM_STAT_ */
+static unsigned char data DIAG_TO; /* Address the counters will be sent to */
+static unsigned char data DIAG_INDEX; /* Index of the next frame of the streamed counters */
+
+/*------------------------------------------------
+Starts transmission of the conversation at TX_TAIL
+by sending its address frame. Once the queue is
+empty, streams the counters if they were asked
+for, otherwise releases the bus.
+Called from the arbitration timer and the serial
+interrupt, so it must not use any locals.
+------------------------------------------------*/
+static void comm_tx_start(void) {
+	TX_DIAG = 0;
+	TX_WAIT = 0; /* Bus is either taken or released */
+	if(RX_STATE == RX_IDLE) SM2 = 1; /* Only address frames matter again */
+
+	if(TX_TAIL == TX_HEAD) {
+		if(DIAG_TO == DIAG_NONE) {
+			TX_BUSY = 0;
+			TX_DEFER = 1; /* Let the others talk first next time */
+			trans_read(); /* Go back into receiving once the queue is empty */
+			return;
+		}
+
+		/*------------------------------------------------
+		Counters are sent as a burst straight from
+		COMM_STATS, they don't need room in the queue.
+		------------------------------------------------*/
+		TX_DIAG = 1;
+		TX_LEFT = STAT_BYTES + 1; /* Number of counters and the counters */
+		DIAG_INDEX = 0;
+		TX_BUSY = 1;
+		trans_send(); /* Enable transmitting for this microcontroller */
+
+		TB8 = 1; /* Set ninth bit to 1, before SBUF latches it */
+			 /* (all microcontrollers will recieve this message) */
+		SBUF = DIAG_TO | BURST; /* Send the address */
+		DIAG_TO = DIAG_NONE;
+	} else {
+		TX_LEFT = TX_QUEUE[TX_TAIL];
+		TX_TAIL = (TX_TAIL + 1) & (TX_SIZE - 1);
+		TX_BUSY = 1;
+		trans_send(); /* Enable transmitting for this microcontroller */
+
+		TB8 = 1; /* Set ninth bit to 1, before SBUF latches it */
+			 /* (all microcontrollers will recieve this message) */
+		SBUF = TX_QUEUE[TX_TAIL]; /* Send the address */
+		TX_TAIL = (TX_TAIL + 1) & (TX_SIZE - 1);
+	}
+
+	COMM_STATS[COMM_STAT_SENT]++;
+}
+
+/*------------------------------------------------
+First sends the message with address of the
+recipient. Then sends the actual values.
+Recipient upon recieving the message with its
+address must change the SM2 to 0.
+Once the values are sent, moves onto the next
+queued conversation.
+Called both from the serial interrupt and
+comm_tx_poll(), so it must not use any locals.
+------------------------------------------------*/
+static void comm_tx_int(void) {
+	TI = 0; /* Reset the transmission bit */
+
+	if(TX_LEFT == 0) { /* Conversation has been sent */
+		comm_tx_start();
+		return;
+	}
+
+	TB8 = 0; /* Set ninth bit to 0 */
+		 /* (only the microcontroller with SM2 == 0 will recieve this message) */
+	if(TX_DIAG == 1) {
+		SBUF = (DIAG_INDEX == 0) ? STAT_BYTES : ((unsigned char idata*)COMM_STATS)[DIAG_INDEX - 1];
+		DIAG_INDEX++;
+	} else {
+		SBUF = TX_QUEUE[TX_TAIL]; /* Send the message */
+		TX_TAIL = (TX_TAIL + 1) & (TX_SIZE - 1);
+	}
+	TX_LEFT--;
+	COMM_STATS[COMM_STAT_SENT]++;
+}
+
+/*------------------------------------------------
+With the serial interrupt disabled, services
+a pending TI by hand. Lets waiting callers make
+progress even from inside another interrupt
+routine the serial interrupt cannot preempt.
+------------------------------------------------*/
+static void comm_tx_poll(void) {
+	bit es = ES;
+
+	ES = 0;
+	if(TI == 1) comm_tx_int();
+	ES = es;
+}
+
+/*------------------------------------------------
+Starts counting down the silence on the bus
+this microcontroller waits for, from the start.
+Called from the serial interrupt, the arbitration
+timer and comm_queue() with interrupts disabled,
+so it must not use any locals.
+------------------------------------------------*/
+static void comm_arb_start(void) {
+	ARB_NEXT = (TX_DEFER == 1) ? ARB_DEFER_RELOAD : ARB_RELOAD;
+
+	if(ARB_TIMER == COMM_TIMER_0) {
+		TR0 = 0;
+		TH0 = ARB_NEXT >> 8;
+		TL0 = ARB_NEXT & 0xFF;
+		TF0 = 0;
+		TR0 = 1;
+	} else if(ARB_TIMER == COMM_TIMER_1) {
+		TR1 = 0;
+		TH1 = ARB_NEXT >> 8;
+		TL1 = ARB_NEXT & 0xFF;
+		TF1 = 0;
+		TR1 = 1;
+	} else if(ARB_TIMER == COMM_TIMER_2) {
+		TR2 = 0;
+		TH2 = ARB_NEXT >> 8;
+		TL2 = ARB_NEXT & 0xFF;
+		TF2 = 0;
+		TR2 = 1;
+	}
+}
+
+/*------------------------------------------------
+Stops the arbitration timer.
+------------------------------------------------*/
+static void comm_arb_stop(void) {
+	if(ARB_TIMER == COMM_TIMER_0) {
+		TR0 = 0;
+	} else if(ARB_TIMER == COMM_TIMER_1) {
+		TR1 = 0;
+	} else if(ARB_TIMER == COMM_TIMER_2) {
+		TR2 = 0;
+		TF2 = 0; /* Not reset by the hardware */
+	}
+}
+
+/*------------------------------------------------
+The bus has been silent for the whole countdown.
+Takes one more look at the bus, in case a frame
+has just started and hasn't been received yet,
+and starts the transmitter.
+Nothing is done if the serial interrupt has
+started it meanwhile to send an acknowledgement.
+------------------------------------------------*/
+void comm_arb_int(void) {
+	comm_arb_stop();
+	if(TX_WAIT == 0) return;
+
+	if(trans_idle(1) == 0) { /* Somebody else is talking */
+		COMM_STATS[COMM_STAT_WAITS]++;
+		comm_arb_start();
+		return;
+	}
+
+	TX_DEFER = 0;
+	comm_tx_start();
+}
+
+/*------------------------------------------------
+Queues a conversation of len messages and returns.
+Unless the transmitter is already sending or
+waiting for the bus, starts the arbitration timer,
+which starts the transmitter once it gets the bus.
+Without an arbitration timer, the transmitter is
+started right away. Acknowledged conversations
+and bursts send header first.
+If the queue is full, waits for the transmitter
+to free enough room by polling TI. Room is only
+checked with interrupts disabled, as both the
+serial interrupt and the arbitration timer use
+the queue.
+------------------------------------------------*/
+static void comm_queue(unsigned char addr, unsigned char header, unsigned char* message, unsigned char len) {
+	bit ea = EA;
+	bit has_header = ((addr & KIND_MASK) == KIND_ACK_REQ || (addr & BURST) != 0);
+
+	EA = 0; /* Interrupts must not touch the queue meanwhile */
+	while(TX_ROOM < len + has_header + 2) { /* Not enough room */
+		EA = ea;
+		COMM_STATS[COMM_STAT_WAITS]++;
+		comm_tx_poll();
+		EA = 0;
+	}
+
+	TX_PUT(len + has_header);
+	TX_PUT(addr);
+	if(has_header) TX_PUT(header);
+	while(len != 0) {
+		TX_PUT(*message);
+		message++;
+		len--;
+	}
+
+	if(TX_BUSY == 0 && TX_WAIT == 0) {
+		if(ARB_TIMER == COMM_TIMER_NONE) {
+			comm_tx_start();
+		} else {
+			TX_WAIT = 1;
+			SM2 = 0; /* Hear every frame on the bus */
+			comm_arb_start();
+		}
+	}
+	EA = ea;
+}
+
 /*------------------------------------------------
 Configures serial port to operate in 9-bit
 communication mode and sets transceiever
 to read by default.
 ------------------------------------------------*/
-void comm_init(void) {
-	
+void comm_init(unsigned char addr, unsigned char timer, unsigned char arb_timer) {
+	unsigned char i;
+
+	COMM_ADDR = addr;
+	COMM_GROUPS = 0;
+
+	if(BAUD_SMOD == 1) PCON |= 0x80; /* Double the baud rate */
+
+#ifdef BAUD_MODE_2
 	/*------------------------------------------------
 	Set mode of serial port to mode 2.
 	------------------------------------------------*/
-	SM0 = 1; 
+	SM0 = 1;
 	SM1 = 0;
-	
+	timer = 0; /* Mode 2 doesn't need a timer */
+#else
+	/*------------------------------------------------
+	Set mode of serial port to mode 3 and start
+	the timer generating the baud rate.
+	------------------------------------------------*/
+	SM0 = 1;
+	SM1 = 1;
+
+	if(timer == COMM_TIMER_1) {
+		TR1 = 0;
+		ET1 = 0; /* Overflows are only for the serial port */
+		TMOD = (TMOD & 0x0F) | 0x20; /* Mode 2: Auto-reload */
+		TH1 = BAUD_T1_RELOAD; /* Set 8 bit value for auto-reload */
+		TL1 = BAUD_T1_RELOAD; /* Initialize the timer */
+		TR1 = 1; /* Start timer 1 */
+	} else {
+		TR2 = 0;
+		ET2 = 0; /* Overflows are only for the serial port */
+		T2CON = 0x30; /* Baud rate generator for both receiving and transmitting */
+		RCAP2H = BAUD_T2_RELOAD >> 8; /* Set value for 8 higher bits */
+		RCAP2L = BAUD_T2_RELOAD & 0xFF; /* Set value for 8 lower bits */
+		TH2 = BAUD_T2_RELOAD >> 8; /* Initialize the timer */
+		TL2 = BAUD_T2_RELOAD & 0xFF; /* Initialize the timer */
+		TR2 = 1; /* Start timer 2 */
+	}
+#endif
+
+	/*------------------------------------------------
+	Prepare the arbitration timer as a 16-bit timer,
+	started by comm_arb_start() when needed.
+	------------------------------------------------*/
+	ARB_TIMER = arb_timer;
+	ARB_RELOAD = 65536UL - (GAP_CYCLES + (addr + 1) * SLOT_CYCLES);
+	ARB_DEFER_RELOAD = ARB_RELOAD - NODE_COUNT * SLOT_CYCLES;
+	if(arb_timer == COMM_TIMER_0) {
+		TR0 = 0;
+		TMOD = (TMOD & 0xF0) | 0x01; /* Mode 1: 16bit counter */
+		ET0 = 1;
+	} else if(arb_timer == COMM_TIMER_1) {
+		TR1 = 0;
+		TMOD = (TMOD & 0x0F) | 0x10; /* Mode 1: 16bit counter */
+		ET1 = 1;
+	} else if(arb_timer == COMM_TIMER_2) {
+		TR2 = 0;
+		T2CON = 0x00; /* 16-bit auto-reload, not used for the baud rate */
+		ET2 = 1;
+	}
+
 	SM2 = 1; /* Activate multiprocess communication */
-	
+
 	REN = 1; /* Activate the receiver */
-	
+
 	/*------------------------------------------------
 	Zero receive/send bits and data bits.
 	------------------------------------------------*/
@@ -35,35 +461,329 @@ void comm_init(void) {
 	RB8 = 0;
 	TI = 0;
 	RI = 0;
-	
+
+	/*------------------------------------------------
+	Empty the transmit queue.
+	------------------------------------------------*/
+	TX_HEAD = 0;
+	TX_TAIL = 0;
+	TX_LEFT = 0;
+	TX_BUSY = 0;
+	TX_DEFER = 0;
+	TX_WAIT = 0;
+	TX_SYNCED = 0;
+	for(i = 0; i < NODE_COUNT; i++) TX_SEQ[i] = 0;
+
+	/*------------------------------------------------
+	Empty the receive queue and forget
+	any acknowledged messages.
+	------------------------------------------------*/
+	RX_HEAD = 0;
+	RX_TAIL = 0;
+	RX_STATE = RX_IDLE;
+	for(i = 0; i < NODE_COUNT; i++) RX_SEQ[i] = ACK_NONE;
+	ACK_HEADER = ACK_NONE;
+
+	/*------------------------------------------------
+	Zero the counters.
+	------------------------------------------------*/
+	for(i = 0; i < COMM_STAT_COUNT; i++) COMM_STATS[i] = 0;
+	DIAG_TO = DIAG_NONE;
+
 	trans_read(); /* Set transceiver to reading by default */
 }
 
 /*------------------------------------------------
-First sends the message with address of the 
-recipient. Then sends the actual value.
-Recipient upon recieving the message with its
-address must change the SM2 to 0.
+Only the lower nibble is kept, so that it can be
+compared directly with group addresses.
+------------------------------------------------*/
+void comm_subscribe(unsigned char groups) {
+	COMM_GROUPS = groups & ADDR_MASK;
+}
+
+/*------------------------------------------------
+Queues the message as a conversation with
+a single message frame.
 ------------------------------------------------*/
 void comm_send(unsigned char addr, unsigned char message) {
-	trans_send(); /* Enable transmitting for this microcontroller */
-	
-	TB8 = 1; /* Set ninth bit to 1 */
-		 /* (all microcontrollers will recieve this message) */
-	SBUF = addr; /* Prepare to send the address */
-	
-	while(TI != 1) {;} /* Wait until the transmission concludes */
-	TI = 0; /* Reset the transmission bit */
-		
-	trans_read();
-	trans_send();
-		
-	TB8 = 0; /* Set ninth bit to 0 */
-		 /* (only the microcontroller with SM2 == 0 will recieve this message) */
-	SBUF = message; /* Prepare to send the message */
-		
-	while(TI == 0) {;} /* Wait until the transmission concludes */
-	TI = 0; /* Reset the transmission bit */
+	comm_queue(addr, 0, &message, 1);
+}
+
+/*------------------------------------------------
+Queues the messages as a single conversation,
+address frame is sent only once, followed by
+the number of messages. A longer burst would
+never fit in the queue, so it isn't sent at all
+rather than waiting for room forever.
+------------------------------------------------*/
+void comm_send_burst(unsigned char addr, unsigned char* buf, unsigned char len) {
+	if(len == 0 || len > COMM_BURST_MAX) return;
+	comm_queue(addr | BURST, len, buf, len);
+}
+
+/*------------------------------------------------
+Sends a query of diagnostic kind, its only
+message frame is the address of this
+microcontroller, where the counters will be sent.
+------------------------------------------------*/
+void comm_diag(unsigned char addr) {
+	comm_send(addr | KIND_DIAG, COMM_ADDR);
+}
+
+/*------------------------------------------------
+Sends a conversation with a header and waits for
+the recipient to send the same header back.
+If it doesn't arrive in time, the conversation is
+sent again with the same header, which lets the
+recipient drop it if only the acknowledgement
+got lost.
+------------------------------------------------*/
+static bit comm_exchange(unsigned char addr, unsigned char seq, unsigned char* message, unsigned char len) {
+	unsigned char ack = HEADER(addr & ADDR_MASK, seq);
+	unsigned char tries;
+	unsigned int wait;
+
+	for(tries = 0; tries <= ACK_RETRIES; tries++) {
+		if(tries != 0) COMM_STATS[COMM_STAT_RETRIES]++;
+		ACK_HEADER = ACK_NONE;
+		comm_queue(addr, HEADER(COMM_ADDR, seq), message, len);
+		comm_flush(); /* Timeout starts once the message has left */
+
+		for(wait = 0; wait < ACK_TIMEOUT; wait++) {
+			if(ACK_HEADER == ack) return 1;
+			COMM_STATS[COMM_STAT_WAITS]++;
+		}
+	}
+
+	return 0;
+}
+
+/*------------------------------------------------
+The first time after comm_init() a recipient is
+sent an acknowledged message, it is first told
+to forget the last header it remembers from this
+microcontroller. Otherwise, after a reset, the
+new sequence numbers could repeat that header
+and the message would be dropped as a repeat.
+Resynchronisation delivers no message, so it can
+be repeated safely.
+------------------------------------------------*/
+bit comm_send_ack(unsigned char addr, unsigned char message) {
+	unsigned char node = addr & (NODE_COUNT - 1);
+	unsigned char mask = 1 << node;
+
+	if((TX_SYNCED & mask) == 0) {
+		if(comm_exchange(addr | SYNC, TX_SEQ[node], 0, 0) == 0) return 0;
+		TX_SYNCED |= mask;
+	}
+
+	TX_SEQ[node]++;
+	return comm_exchange(addr | KIND_ACK_REQ, TX_SEQ[node], &message, 1);
+}
+
+/*------------------------------------------------
+Waits by polling TI until the queue is empty and
+the last frame has left the transmitter.
+------------------------------------------------*/
+void comm_flush(void) {
+	while(TX_BUSY == 1 || TX_WAIT == 1) {
+		COMM_STATS[COMM_STAT_WAITS]++;
+		comm_tx_poll();
+	}
+}
+
+/*------------------------------------------------
+Returns whether comm_read() has a message
+waiting.
+------------------------------------------------*/
+bit comm_available(void) {
+	return RX_HEAD != RX_TAIL;
+}
+
+/*------------------------------------------------
+Takes the oldest message out of the receive
+queue, waiting for one if it is empty.
+Only the serial interrupt moves RX_HEAD and
+only this function moves RX_TAIL, so neither
+needs the interrupt to be disabled.
+------------------------------------------------*/
+unsigned char comm_read(void) {
+	unsigned char message;
+
+	while(RX_HEAD == RX_TAIL) { /* Wait until a message arrives */
+		COMM_STATS[COMM_STAT_WAITS]++;
+	}
+	message = RX_MESSAGE[RX_TAIL];
+	RX_TAIL = (RX_TAIL + 1) & (RX_SIZE - 1);
+	return message;
+}
+
+/*------------------------------------------------
+Prepares to store len messages of the current
+conversation. Messages are only handed over
+to comm_read() once the whole conversation has
+arrived, so that a burst is never read partially.
+If the receive queue doesn't have room for all
+of them, the whole conversation is dropped.
+Only called from the serial interrupt.
+------------------------------------------------*/
+static void comm_rx_begin(unsigned char len) {
+	RX_STATE = RX_DATA;
+	RX_LEFT = len;
+	RX_STORE = RX_HEAD;
+	RX_DROP = (((RX_TAIL - RX_HEAD - 1) & (RX_SIZE - 1)) < len);
+	if(RX_DROP == 1) COMM_STATS[COMM_STAT_OVERRUNS]++;
+}
+
+/*------------------------------------------------
+Queues the acknowledgement of RX_ACK_HEADER.
+If there is no room, the sender will try again.
+Only called from the serial interrupt.
+------------------------------------------------*/
+static void comm_rx_ack(void) {
+	if(TX_ROOM >= 3) {
+		TX_PUT(1);
+		TX_PUT(HEADER_ADDR(RX_ACK_HEADER) | KIND_ACK);
+		TX_PUT(HEADER(COMM_ADDR, RX_ACK_HEADER));
+		if(TX_BUSY == 0) comm_tx_start(); /* Sender keeps quiet until it arrives */
+	}
+}
+
+/*------------------------------------------------
+Hands the stored conversation over to comm_read().
+If the conversation is acknowledged, also queues
+the acknowledgement, unless it had to be dropped
+so that the sender tries again.
+A repeated acknowledged message is acknowledged
+again but not handed over twice.
+Only called from the serial interrupt.
+------------------------------------------------*/
+static void comm_rx_end(void) {
+	bit repeated = 0;
+
+	RX_STATE = RX_IDLE;
+	RX_UNADDRESSED(); /* Conversation is over, wait for next address */
+	if(RX_DROP == 1) return;
+
+	if(RX_ACKED == 1) {
+		repeated = (RX_SEQ[HEADER_ADDR(RX_ACK_HEADER) & (NODE_COUNT - 1)] == RX_ACK_HEADER);
+		RX_SEQ[HEADER_ADDR(RX_ACK_HEADER) & (NODE_COUNT - 1)] = RX_ACK_HEADER;
+		comm_rx_ack();
+	}
+
+	if(repeated == 0) RX_HEAD = RX_STORE;
+}
+
+/*------------------------------------------------
+Reads the address frame and decides whether the
+rest of the conversation is for this
+microcontroller and what it contains.
+Only called from the serial interrupt.
+------------------------------------------------*/
+static void comm_rx_addr(void) {
+	unsigned char addr = SBUF;
+
+	RX_STATE = RX_IDLE;
+	RX_UNADDRESSED();
+
+	if((addr & COMM_GROUP) != 0) { /* Only listen further if addressed */
+		if((addr & COMM_GROUPS) == 0) {
+			COMM_STATS[COMM_STAT_FILTERED]++;
+			return;
+		}
+	} else {
+		if((addr & ADDR_MASK) != COMM_ADDR) {
+			COMM_STATS[COMM_STAT_FILTERED]++;
+			return;
+		}
+	}
+	SM2 = 0;
+	COMM_STATS[COMM_STAT_RECEIVED]++;
+
+	RX_ACKED = ((addr & KIND_MASK) == KIND_ACK_REQ);
+	if((addr & (KIND_MASK | BURST)) == SYNC) {
+		RX_STATE = RX_SYNC;
+	} else if((addr & KIND_MASK) == KIND_ACK) {
+		RX_STATE = RX_ACK;
+	} else if((addr & KIND_MASK) == KIND_DIAG) {
+		RX_STATE = RX_DIAG;
+	} else if(RX_ACKED == 1) {
+		RX_STATE = RX_HEADER;
+	} else if((addr & BURST) != 0) {
+		RX_STATE = RX_LENGTH;
+	} else {
+		comm_rx_begin(1);
+	}
+}
+
+/*------------------------------------------------
+Reads a message frame of the conversation
+this microcontroller is listening to. Frames of
+other conversations only arrive while waiting for
+the bus and are ignored.
+Only called from the serial interrupt.
+------------------------------------------------*/
+static void comm_rx_data(void) {
+	if(RX_STATE == RX_IDLE) return;
+	COMM_STATS[COMM_STAT_RECEIVED]++;
+
+	if(RX_STATE == RX_ACK) {
+		ACK_HEADER = SBUF;
+		RX_STATE = RX_IDLE;
+		RX_UNADDRESSED();
+	} else if(RX_STATE == RX_DIAG) {
+		DIAG_TO = SBUF & ADDR_MASK;
+		RX_STATE = RX_IDLE;
+		RX_UNADDRESSED();
+		if(TX_BUSY == 0) comm_tx_start(); /* Otherwise counters follow the queued conversations */
+	} else if(RX_STATE == RX_SYNC) {
+		RX_ACK_HEADER = SBUF;
+		RX_SEQ[HEADER_ADDR(RX_ACK_HEADER) & (NODE_COUNT - 1)] = ACK_NONE; /* Accept any header next */
+		RX_STATE = RX_IDLE;
+		RX_UNADDRESSED();
+		comm_rx_ack();
+	} else if(RX_STATE == RX_HEADER) {
+		RX_ACK_HEADER = SBUF;
+		comm_rx_begin(1);
+	} else if(RX_STATE == RX_LENGTH) {
+		if(SBUF == 0) {
+			RX_STATE = RX_IDLE;
+			RX_UNADDRESSED();
+		} else {
+			comm_rx_begin(SBUF);
+		}
+	} else if(RX_STATE == RX_DATA) {
+		if(RX_DROP == 0) {
+			RX_MESSAGE[RX_STORE] = SBUF;
+			RX_STORE = (RX_STORE + 1) & (RX_SIZE - 1);
+		}
+		RX_LEFT--;
+		if(RX_LEFT == 0) comm_rx_end();
+	}
+}
+
+/*------------------------------------------------------------------------------
+Serial interrupt shared by every microcontroller.
+Since serial port is configured in 9-bit multiprocess communication mode.
+Each conversation starts with a frame containing address of the recipient
+microcontroller followed by frames with the actual messages.
+After reading its own address or the address of a group it is subscribed to
+the microcontroller changes SM2 to 0, stores the following messages in the
+receive queue and sets SM2 back to 1 once the conversation is over.
+Nothing else is done here, each microcontroller processes the messages
+in its main loop, so the interrupt stays short for the timer interrupts.
+------------------------------------------------------------------------------*/
+void SIO_int(void) interrupt SIO_VECTOR {
+	if(RI == 1) {
+		RI = 0; /* Reset recieving bit */
+		if(TX_WAIT == 1) comm_arb_start(); /* Bus is busy, count the silence from now */
+
+		if(RB8 == 1) { /* Address frame */
+			comm_rx_addr();
+		} else {
+			comm_rx_data();
+		}
+	}
 
-	trans_read(); /* Go back into receiving once the message is sent */
+	if(TI == 1) comm_tx_int(); /* Transmit next queued frame */
 }
@@ -4,9 +4,19 @@ comm.h
 Header file for comm.c, contains declarations of functions used to control
 the serial communcation port.
 
-comm_read(void) is not implemented here and must be implemented
-in each microcontroller's main.c separately, as the function will greatly differ
-for each one.
+Both directions are interrupt driven. comm_send() queues the message and
+the serial interrupt defined in comm.c sends it. Received messages are queued
+by the same interrupt and each microcontroller processes them in its main loop
+with comm_read(void), as the processing will greatly differ for each one.
+Microcontrollers must not define their own serial interrupt.
+
+Any microcontroller may start a conversation. Before taking the bus it listens
+until the bus has been idle long enough, lower addresses wait less, see comm.c.
+The silence is timed by an arbitration timer, whose interrupt routine each
+microcontroller defines and calls comm_arb_int() from, so sending never waits
+for the bus.
+Collisions which still happen can't be detected, so messages which must arrive
+should be sent with comm_send_ack().
 ------------------------------------------------------------------------------*/
 
 /*------------------------------------------------
@@ -15,20 +25,145 @@ Include macro guard
 #ifndef __COMM_H__
 #define __COMM_H__
 
+#include "timing.h" /* F_OSC and COMM_BAUD */
+
+/*------------------------------------------------
+Timers generating the baud rate in serial mode 3
+and timing the arbitration. Each microcontroller
+chooses ones it doesn't use for anything else.
+------------------------------------------------*/
+#define COMM_TIMER_0 0
+#define COMM_TIMER_1 1
+#define COMM_TIMER_2 2
+#define COMM_TIMER_NONE 0xFF
+
+/*------------------------------------------------
+Marks a group address. Lower nibble of a group
+address selects up to 4 groups, a message sent
+to a group address reaches every microcontroller
+subscribed to any of them.
+------------------------------------------------*/
+#define COMM_GROUP 0x80
+
+/*------------------------------------------------
+Largest number of messages in a single burst
+the transmit queue has room for.
+------------------------------------------------*/
+#define COMM_BURST_MAX 12
+
 /*------------------------------------------------
-Initializes the serial port.
+Bus counters kept by every microcontroller,
+sent back by comm_diag() in this order.
+------------------------------------------------*/
+#define COMM_STAT_SENT 0 /* Frames sent */
+#define COMM_STAT_RECEIVED 1 /* Frames received, addressed to this microcontroller */
+#define COMM_STAT_FILTERED 2 /* Address frames addressed to other microcontrollers */
+#define COMM_STAT_WAITS 3 /* Polls spent waiting for the transmitter, a message or an acknowledgement */
+#define COMM_STAT_RETRIES 4 /* Acknowledged messages sent again */
+#define COMM_STAT_OVERRUNS 5 /* Conversations dropped, because the receive queue was full */
+#define COMM_STAT_COUNT 6
+
+/*------------------------------------------------
+Initializes the serial port, where
+addr - is the address of this microcontroller,
+only messages sent to it will be received.
+timer - COMM_TIMER_1 or COMM_TIMER_2, timer which
+generates the baud rate, unused in serial mode 2.
+arb_timer - COMM_TIMER_0, COMM_TIMER_1 or
+COMM_TIMER_2, timer which times the arbitration,
+its interrupt routine must call comm_arb_int().
+Must differ from timer in serial mode 3.
+COMM_TIMER_NONE if the microcontroller never
+sends, anything sent anyway skips arbitration.
 Must be called before using any functions from
 comm.h
 ------------------------------------------------*/
-void comm_init(void);
+void comm_init(unsigned char addr, unsigned char timer, unsigned char arb_timer);
+
+/*------------------------------------------------
+Must be called from the interrupt routine of the
+arbitration timer chosen in comm_init(), starts
+the transmitter once the bus has been silent
+long enough.
+------------------------------------------------*/
+void comm_arb_int(void);
+
+/*------------------------------------------------
+Subscribes to given groups, after which messages
+sent to any of them will be received as well.
+groups - group address, replaces the groups
+         subscribed to so far.
+------------------------------------------------*/
+void comm_subscribe(unsigned char groups);
 
 /*------------------------------------------------
 Sends a message to microcontroller of given
-address. For this to work all other microcontrollers
-must be initialized with comm_init(void) beforehand.
+address or to every member of given group.
+For this to work all other microcontrollers
+must be initialized with comm_init() beforehand.
+
+Returns as soon as the message is queued, it is
+sent once the arbitration timer finds the bus
+free. Only blocks when the queue is full, until
+the oldest queued message has been sent.
 ------------------------------------------------*/
 void comm_send(unsigned char addr, unsigned char message);
 
+/*------------------------------------------------
+Sends len messages from buf to the microcontroller
+or group of given address, as one conversation.
+The address is sent only once and the recipient
+receives all of the messages or none of them,
+so it can read them with comm_read() right away
+once the first one is available.
+len - <1, COMM_BURST_MAX>, nothing is sent
+      if it is out of range.
+------------------------------------------------*/
+void comm_send_burst(unsigned char addr, unsigned char* buf, unsigned char len);
+
+/*------------------------------------------------
+Sends a message like comm_send(), but waits
+until the recipient acknowledges it, sending
+it again a few times if needed. The first one
+sent to each recipient after comm_init() takes
+an extra exchange, see comm.c.
+Returns 1 once the message is acknowledged,
+0 if the recipient never acknowledged it.
+addr must not be a group address.
+Must not be called from an interrupt routine.
+------------------------------------------------*/
+bit comm_send_ack(unsigned char addr, unsigned char message);
+
+/*------------------------------------------------
+Waits until every queued message has been sent.
+------------------------------------------------*/
+void comm_flush(void);
+
+/*------------------------------------------------
+Asks the microcontroller of given address to send
+back its bus counters. They arrive as a burst of
+COMM_STAT_COUNT*2 messages, which can be read with
+comm_read(). Each counter is 16-bit, higher byte
+first, in order of the COMM_STAT_ indexes.
+Counters are sent from the serial interrupt of
+the recipient, without involving its main loop.
+addr must not be a group address.
+------------------------------------------------*/
+void comm_diag(unsigned char addr);
+
+/*------------------------------------------------
+Returns 1 if a received message is waiting
+to be read, 0 otherwise.
+------------------------------------------------*/
+bit comm_available(void);
+
+/*------------------------------------------------
+Returns the oldest received message.
+If no message is waiting, waits until one
+arrives. Use comm_available() to avoid waiting.
+------------------------------------------------*/
+unsigned char comm_read(void);
+
 /*------------------------------------------------
 END: #ifndef __COMM_H__
 ------------------------------------------------*/
@@ -0,0 +1,171 @@
+/*------------------------------------------------------------------------------
+timing.h 
+
+Header file shared by all microcontrollers, computes reload values of the timers
+from the crystal frequency and the wanted rates at compile time.
+
+Every value can be overridden in the C51 defines of the project. Every computed
+reload is checked by the preprocessor, so a rate a timer can't generate stops
+the build instead of silently wrapping around.
+
+Dictionary:
+Machine cycle - 12 periods of the crystal, timers count machine cycles.
+------------------------------------------------------------------------------*/
+
+/*------------------------------------------------
+Include macro guard
+------------------------------------------------*/
+#ifndef __TIMING_H__
+#define __TIMING_H__
+
+/*------------------------------------------------
+Crystal frequency of the microcontrollers in Hz.
+To calibrate timekeeping, set it to the measured
+frequency of the crystal.
+------------------------------------------------*/
+#ifndef F_OSC
+#define F_OSC 12000000
+#endif
+
+#define CYCLES_PER_SECOND (F_OSC / 12) /* Machine cycles in a second */
+
+/*------------------------------------------------
+Baud rate of the bus. Every microcontroller must
+be built with the same value.
+
+A baud rate of F_OSC/64 or F_OSC/32 uses serial
+mode 2, which needs no timer. Other rates use
+serial mode 3 with the timer chosen in comm_init().
+Timer 1 in 8-bit auto-reload mode divides F_OSC
+by 12*32*(256-TH1), halved with SMOD set, and
+timer 2 in baud rate generator mode divides F_OSC
+by 32*(65536-RCAP2). Only rates both timers can
+generate within 0.2% are accepted.
+------------------------------------------------*/
+#ifndef COMM_BAUD
+#define COMM_BAUD (F_OSC / 64)
+#endif
+
+#if COMM_BAUD == F_OSC / 64
+#define BAUD_MODE_2
+#define BAUD_SMOD 0
+#elif COMM_BAUD == F_OSC / 32
+#define BAUD_MODE_2
+#define BAUD_SMOD 1
+#else
+
+#if (F_OSC + 96L * COMM_BAUD) / (192L * COMM_BAUD) <= 256
+#define BAUD_SMOD 1 /* Finer steps of timer 1 */
+#else
+#define BAUD_SMOD 0
+#endif
+
+#define BAUD_T1_PRESCALE (384L >> BAUD_SMOD)
+#define BAUD_T1_DIV ((F_OSC + BAUD_T1_PRESCALE / 2 * COMM_BAUD) / (BAUD_T1_PRESCALE * COMM_BAUD))
+#define BAUD_T2_DIV ((F_OSC + 16L * COMM_BAUD) / (32L * COMM_BAUD))
+#define BAUD_T1_RELOAD (256 - BAUD_T1_DIV)
+#define BAUD_T2_RELOAD (65536 - BAUD_T2_DIV)
+
+#if BAUD_T1_DIV < 1 || BAUD_T1_DIV > 256 || BAUD_T2_DIV < 1 || BAUD_T2_DIV > 65536
+#error "COMM_BAUD is out of range of the timers with this F_OSC"
+#endif
+
+#if F_OSC - BAUD_T1_PRESCALE * BAUD_T1_DIV * COMM_BAUD > F_OSC / 500 || \
+    BAUD_T1_PRESCALE * BAUD_T1_DIV * COMM_BAUD - F_OSC > F_OSC / 500
+#error "COMM_BAUD can't be generated by timer 1 with this F_OSC"
+#endif
+
+#if F_OSC - 32L * BAUD_T2_DIV * COMM_BAUD > F_OSC / 500 || \
+    32L * BAUD_T2_DIV * COMM_BAUD - F_OSC > F_OSC / 500
+#error "COMM_BAUD can't be generated by timer 2 with this F_OSC"
+#endif
+
+#endif
+
+/*------------------------------------------------
+Tick of the LCD, generated by timer 2 in 16-bit
+auto-reload mode. Paces the LCD and counts the
+seconds of the timer.
+------------------------------------------------*/
+#ifndef TICK_HZ
+#define TICK_HZ 100
+#endif
+
+#define TICK_CYCLES (CYCLES_PER_SECOND / TICK_HZ)
+#define TICK_RELOAD (65536 - TICK_CYCLES)
+
+#if TICK_CYCLES < 1 || TICK_CYCLES > 65536
+#error "TICK_HZ is out of range of timer 2 with this F_OSC"
+#endif
+
+/*------------------------------------------------
+Multiplexing of the 7-segment digital displays,
+generated by timer 1 in 8-bit auto-reload mode.
+Each interrupt powers the next display.
+------------------------------------------------*/
+#ifndef MUX_HZ
+#define MUX_HZ 4000
+#endif
+
+#define MUX_CYCLES (CYCLES_PER_SECOND / MUX_HZ)
+#define MUX_RELOAD (256 - MUX_CYCLES)
+
+#if MUX_CYCLES < 1 || MUX_CYCLES > 256
+#error "MUX_HZ is out of range of timer 1 with this F_OSC"
+#endif
+
+/*------------------------------------------------
+Blinking and animation steps of the 7-segment
+digital displays, generated by timer 0 in 16-bit
+mode.
+------------------------------------------------*/
+#ifndef BLINK_HZ
+#define BLINK_HZ 16
+#endif
+
+#define BLINK_CYCLES (CYCLES_PER_SECOND / BLINK_HZ)
+#define BLINK_RELOAD (65536 - BLINK_CYCLES)
+
+#if BLINK_CYCLES < 1 || BLINK_CYCLES > 65536
+#error "BLINK_HZ is out of range of timer 0 with this F_OSC"
+#endif
+
+/*------------------------------------------------
+Scanning of the keyboard, generated by timer 0
+in 16-bit mode.
+------------------------------------------------*/
+#ifndef SCAN_HZ
+#define SCAN_HZ 200
+#endif
+
+#define SCAN_CYCLES (CYCLES_PER_SECOND / SCAN_HZ)
+#define SCAN_RELOAD (65536 - SCAN_CYCLES)
+
+#if SCAN_CYCLES < 1 || SCAN_CYCLES > 65536
+#error "SCAN_HZ is out of range of timer 0 with this F_OSC"
+#endif
+
+/*------------------------------------------------
+Pulse width modulation of the motor, generated by
+timer 2 in 16-bit auto-reload mode. Timer 2
+overflows only on the two edges of every period,
+its reload is switched between the on-time and
+the off-time. Neither may be shorter than
+PWM_EDGE_CYCLES, so that the interrupt routine
+has written the next reload before it is used.
+------------------------------------------------*/
+#ifndef PWM_HZ
+#define PWM_HZ 200
+#endif
+
+#define PWM_CYCLES (CYCLES_PER_SECOND / PWM_HZ) /* Machine cycles in a period */
+#define PWM_EDGE_CYCLES 100 /* Shortest on-time or off-time */
+
+#if PWM_CYCLES < 2 * PWM_EDGE_CYCLES || PWM_CYCLES > 65536
+#error "PWM_HZ is out of range of timer 2 with this F_OSC"
+#endif
+
+/*------------------------------------------------
+END: #ifndef __TIMING_H__
+------------------------------------------------*/
+#endif
@@ -23,4 +23,17 @@ RE = 1 (~P3_4)
 ------------------------------------------------*/
 void trans_read(void) {
 	P3_4 = 0;
-}
\ No newline at end of file
+}
+
+/*------------------------------------------------
+RO of the transceiver drives RXD (P3_0), which
+idles high between frames. Only meaningful while
+the transceiver is reading.
+------------------------------------------------*/
+bit trans_idle(unsigned int polls) {
+	while(polls != 0) {
+		if(P3_0 == 0) return 0; /* Somebody is transmitting */
+		polls--;
+	}
+	return 1;
+}
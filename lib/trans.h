@@ -25,6 +25,17 @@ allowing to read data from the bus.
 ------------------------------------------------*/
 void trans_read(void);
 
+/*------------------------------------------------
+Polls the bus the given number of times and
+returns 1 if nobody transmitted meanwhile.
+Returns 0 as soon as the bus gets busy.
+The driver and the receiver share P3_4, so the
+bus can't be read while this transceiver sends
+and collisions can't be detected by reading
+back what was sent.
+------------------------------------------------*/
+bit trans_idle(unsigned int polls);
+
 /*------------------------------------------------
 END: #ifndef __TRANS_H__
 ------------------------------------------------*/
@@ -12,41 +12,67 @@ Main file of the microcontroller responsible for operation of motor.
 
 #include "../lib/comm.h" /* Serial communication control */
 
-static volatile unsigned char data speed;
-static unsigned char pwm_state;
+#include "../lib/timing.h" /* Length of the PWM period */
 
 /*------------------------------------------------------------------------------
-Triggers on message transmission from keyboard, indicating change of state.
-Since serial port is configured in 9-bit multiprocess communication mode.
-Each message consists of two messages. First one contains address of the 
-recipient microcontroller, second one the actual message. 
-After reading the address addressed microcontroller changes SM2 to 0.
+Reloads of timer 2 for both parts of the PWM period, only written with the timer
+2 interrupt disabled.
 ------------------------------------------------------------------------------*/
-void SIO_int(void) interrupt SIO_VECTOR {
-	EA = 0;
+static unsigned int data on_reload; /* Reload lasting the on-time */
+static unsigned int data off_reload; /* Reload lasting the off-time */
+static bit pwm_high; /* Stores whether the motor is enabled in the current part */
+
+/*------------------------------------------------------------------------------
+Sets the duty of the PWM for a speed mode <0, 9>, (speed*10 + 10)/256 of the
+period. Timer 2 only starts if it isn't running, so a change of speed never
+cuts a period short.
+------------------------------------------------------------------------------*/
+static void set_speed(unsigned char speed) {
+	unsigned int on = (unsigned long)PWM_CYCLES * (speed*10 + 10) / 256;
 	
-	while(RI != 1) {;} /* Wait until the recieving concludes */
-	RI = 0; /* Reset recieving bit */
-		
-	if(SM2 == 1) {
-		if(SBUF == COMM_ID) SM2 = 0;
-		EA = 1;
-		return;
-	}
-	SM2 = 1;
+	if(on < PWM_EDGE_CYCLES) on = PWM_EDGE_CYCLES;
+	if(on > PWM_CYCLES - PWM_EDGE_CYCLES) on = PWM_CYCLES - PWM_EDGE_CYCLES;
+	
+	ET2 = 0;
+	on_reload = 65536UL - on;
+	off_reload = 65536UL - (PWM_CYCLES - on);
+	ET2 = 1;
+	
+	if(TR2) return;
+	
+	/*------------------------------------------------
+	First overflow comes right away and starts
+	the on-time.
+	------------------------------------------------*/
+	MOTOR_ENABLE = 0;
+	pwm_high = 0;
+	TF2 = 0;
+	RCAP2H = on_reload >> 8; /* Set value for 8 higher bits */
+	RCAP2L = on_reload & 0xFF; /* Set value for 8 lower bits */
+	TH2 = 0xFF; /* Initialize the timer */
+	TL2 = 0xFF; /* Initialize the timer */
+	TR2 = 1;
+}
 
-	if(SBUF == COMM_RESET) {
+/*------------------------------------------------------------------------------
+Processes a message from keyboard or LCD, indicating change of state.
+Called from the main loop for every message taken out of the receive queue.
+------------------------------------------------------------------------------*/
+static void process_message(unsigned char message) {
+	if(message == COMM_RESET) {
 		motor_stop();
 		TR2 = 0;
+		TF2 = 0; /* Drop an edge which might be pending */
 		MOTOR_ENABLE = 0;
 		
 		/* Turn off the lamps */
 		P2_3 = 0;
 		P2_2 = 0;
 		P2_1 = 0;
-	} else if(SBUF == COMM_TIMER_END) {
+	} else if(message == COMM_TIMER_END) {
 		motor_stop();
 		TR2 = 0;
+		TF2 = 0; /* Drop an edge which might be pending */
 		MOTOR_ENABLE = 0;
 		
 		/* Turn on the lamps */
@@ -55,27 +81,44 @@ void SIO_int(void) interrupt SIO_VECTOR {
 		P2_1 = 1;
 	} else {
 		motor_start();
-		TR2 = 1;
-		speed = SBUF;
+		set_speed(message);
 	}
-	EA = 1;
 }
 
+/*------------------------------------------------------------------------------
+Timer 2 overflows on both edges of the PWM. The timer has already reloaded the
+length of the part starting now, so the routine only switches the motor and
+sets the reload of the following part.
+------------------------------------------------------------------------------*/
 void t2_int(void) interrupt TF2_VECTOR {
-	if(pwm_state < speed*10 + 10) {
-		MOTOR_ENABLE = 1;
-	} else {
+	TF2 = 0; /* Reset overflow flag */
+	
+	if(pwm_high) {
 		MOTOR_ENABLE = 0;
+		RCAP2H = on_reload >> 8;
+		RCAP2L = on_reload & 0xFF;
+	} else {
+		MOTOR_ENABLE = 1;
+		RCAP2H = off_reload >> 8;
+		RCAP2L = off_reload & 0xFF;
 	}
-	
-	pwm_state++;
+	pwm_high = !pwm_high;
+}
+
+/*------------------------------------------------------------------------------
+This timer counts down the silence on the bus before the motor talks,
+started and stopped by comm.c.
+------------------------------------------------------------------------------*/
+void t0_int(void) interrupt TF0_VECTOR {
+	comm_arb_int();
 }
 
 /*------------------------------------------------
 The main C function.
 ------------------------------------------------*/
 void main(void) {
-	comm_init(); /* Initialise the serial port */
+	comm_init(COMM_ID, COMM_TIMER_1, COMM_TIMER_0); /* Initialise the serial port, timer 2 drives the motor */
+	comm_subscribe(RESET_GROUP | SPEED_GROUP);
 	
 	/* Turn off the lamps */
 	P2_3 = 0;
@@ -85,8 +128,9 @@ void main(void) {
 	ES = 1; /* Enable serial interrupts */
 	EA = 1; /* Enable global interrutps */
 	
-	speed = 0;
 	motor_rotate();
 	
-	while(1) {;}
+	while(1) {
+		if(comm_available()) process_message(comm_read());
+	}
 }
\ No newline at end of file
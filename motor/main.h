@@ -15,13 +15,19 @@ ID of microcontroller used in communication
 ------------------------------------------------*/
 #define COMM_ID 3
 
+/*------------------------------------------------
+Groups the microcontroller subscribes to
+------------------------------------------------*/
+#define RESET_GROUP (COMM_GROUP | 0x01) /* Reset together with the mixer */
+#define SPEED_GROUP (COMM_GROUP | 0x02) /* Follow the speed mode */
+
 /*------------------------------------------------
 List of possible communication messages
 received in the serial port
 ------------------------------------------------*/
 #define COMM_RESET 0xFF /* Reset the state of the microcontroller */
 #define COMM_TIMER_END 0x0A /* The timer has concluded */
-/* - */ /* Message with numercial value of currently chosen speed mode */
+/* - */ /* Message with numercial value of currently chosen speed mode (also sent to SPEED_GROUP) */
 
 /*------------------------------------------------
 END: #ifndef __MAIN_H__
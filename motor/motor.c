@@ -16,7 +16,7 @@ Definitions of motor pins
 
 /*------------------------------------------------
 Rotation speed is implemented using
-pulse width modulation with help of timer 0
+pulse width modulation with help of timer 2
 ------------------------------------------------*/
 void motor_rotate(void) {
 	/*------------------------------------------------
@@ -25,15 +25,12 @@ void motor_rotate(void) {
 	MOTOR_ENABLE = 0;
 	
 	/*------------------------------------------------
-	Prepate timer 2
+	Prepate timer 2, its reloads are set once
+	the speed is known
 	------------------------------------------------*/
 	TR2 = 0; /* In case timer has been running stop it */
-	EXEN2 = 0; /* Don't trigger on falling slope of T2EX */
-	RCAP2L = 0xFF; /* Set value for 8 lower bits */
-	RCAP2H = 0xFF; /* Set value for 8 higher bits */
+	T2CON = 0x00; /* 16-bit auto-reload, not used for the baud rate */
 	ET2 = 1; /* Enable timer 2 interrupt */
-	TH2 = 0xFF; /* Initialize the timer */
-	TL2 = 0xFF; /* Initialize the timer */
 	
 	/*------------------------------------------------
 	Define direction of rotation for motor.